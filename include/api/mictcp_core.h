@@ -4,18 +4,57 @@
 #include "../mictcp/mictcp.h"
 #include <math.h>
 
+#ifndef API_MTU
+  #define API_MTU 1500
+#endif
+#ifndef API_BATCH_Size
+  #define API_BATCH_Size 32
+#endif
+#ifndef API_APP_BUFFER_Size
+  #define API_APP_BUFFER_Size 262144 /* octets, puissance de 2 */
+#endif
+
+/* Place occupée dans le tampon applicatif par un message de size octets :
+   sa taille sur 4 octets, puis ses données complétées à un multiple de 4 */
+#define API_APP_BUFFER_Footprint(size) (4 + (((unsigned int) (size) + 3) & ~3U))
+
+/*
+ * Tailles de lots atteintes par recvmmsg/sendmmsg
+ */
+typedef struct ip_batch_stats
+{
+  unsigned long rx_calls; /* nombre de lots reçus */
+  unsigned long rx_datagrams; /* nombre de datagrammes reçus */
+  unsigned long rx_max_batch; /* plus grand lot reçu */
+  unsigned long tx_calls; /* nombre de lots envoyés */
+  unsigned long tx_datagrams; /* nombre de datagrammes envoyés par lot */
+  unsigned long tx_max_batch; /* plus grand lot envoyé */
+} ip_batch_stats;
+
 /**************************************************************
  * Public core functions, can be used for implementing mictcp *
  **************************************************************/
 
 int initialize_components(start_mode sm);
 
-int IP_send(int sys_socket, mic_tcp_pdu, mic_tcp_ip_addr);
-int IP_recv(int sys_socket, mic_tcp_pdu* pk, mic_tcp_ip_addr* local_addr, mic_tcp_ip_addr* remote_addr, unsigned long timeout);
-int app_buffer_get(mic_tcp_payload);
-void app_buffer_put(mic_tcp_payload);
+int IP_resolve(mic_tcp_ip_addr addr, struct sockaddr_in* sys_addr);
+int IP_send(int sys_socket, mic_tcp_pdu, const struct sockaddr_in* addr);
+int IP_recv(int sys_socket, mic_tcp_pdu* pk, struct sockaddr_in* remote_addr, unsigned long timeout);
+int IP_recv_batch(int sys_socket, mic_tcp_pdu* pks, struct sockaddr_in* remote_addrs, int count, unsigned long timeout);
+int IP_try_recv_batch(int sys_socket, mic_tcp_pdu* pks, struct sockaddr_in* remote_addrs, int count);
+void IP_send_batch_begin();
+int IP_send_batch_flush();
+void IP_get_batch_stats(ip_batch_stats* stats);
+int app_buffer_init(app_buffer*);
+void app_buffer_free(app_buffer*);
+void app_buffer_close(app_buffer*);
+int app_buffer_get(app_buffer*, mic_tcp_payload);
+int app_buffer_put(app_buffer*, mic_tcp_payload);
+unsigned int app_buffer_space(app_buffer*);
 
 void set_loss_rate(unsigned short);
+int IP_set_impairment(int sys_socket, const mic_tcp_impairment* model);
+void IP_clear_impairment(int sys_socket);
 unsigned long get_now_time_msec();
 unsigned long get_now_time_usec();
 
@@ -28,7 +67,7 @@ unsigned long get_now_time_usec();
 #ifndef API_SC_Port
   #define API_SC_Port 8525
 #endif
-#define API_HD_Size 16
+#define API_HD_Size ((int) sizeof(mic_tcp_header))
 
 typedef struct ip_payload
 {
@@ -37,7 +76,6 @@ typedef struct ip_payload
 } ip_payload;
 
 int mic_tcp_core_send(mic_tcp_payload);
-mic_tcp_payload get_full_stream(mic_tcp_pdu);
 mic_tcp_payload get_mic_tcp_data(ip_payload);
 mic_tcp_header get_mic_tcp_header(ip_payload);
 void* listening(void*);
@@ -0,0 +1,27 @@
+#ifndef MICTCP_IMPAIRMENT_H
+#define MICTCP_IMPAIRMENT_H
+
+#include "mictcp_core.h"
+
+/* Nombre maximal de copies d'un datagramme (original et doublon) */
+#define IMPAIRMENT_MAX_COPIES 2
+
+/*
+ * Fonctions internes au coeur, utilisées par IP_send
+ */
+
+/*
+ * Décide du sort d'un datagramme émis sur sys_socket : renvoie le nombre de
+ * copies à émettre (0 s'il est perdu) et le délai de chacune dans delays (µs,
+ * 0 pour une émission immédiate). Sans modèle, seul default_loss_rate
+ * s'applique.
+ */
+int impairment_plan(int sys_socket, unsigned short default_loss_rate, unsigned long* delays);
+
+/*
+ * Confie une copie du PDU à la file d'émission différée, renvoie -1 si elle
+ * ne peut pas être retardée (le PDU est alors émis immédiatement).
+ */
+int impairment_defer(int sys_socket, const struct sockaddr_in* addr, const mic_tcp_pdu* pk, unsigned long delay_usec);
+
+#endif
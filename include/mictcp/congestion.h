@@ -0,0 +1,64 @@
+#ifndef MICTCP_CONGESTION_H
+#define MICTCP_CONGESTION_H
+
+#include "mictcp.h"
+
+/*
+ * Algorithme de contrôle de congestion, appelé par la fenêtre d'émission sous
+ * sock->lock. Il ne fait que régler sock->cwnd et sock->ssthresh.
+ */
+typedef struct congestion_ops
+{
+    const char *name;
+    /* des PDUs ont été acquittés, rtt_sample vaut 0 sans mesure (Karn) */
+    void (*on_ack)(mic_tcp_sock *sock, unsigned int acked, unsigned long rtt_sample);
+    /* CONGESTION_DUPACK_THRESHOLD ACKs dupliqués ou un NACK : perte isolée */
+    void (*on_loss)(mic_tcp_sock *sock);
+    /* expiration du plus ancien PDU en vol */
+    void (*on_timeout)(mic_tcp_sock *sock);
+} congestion_ops;
+
+/**
+ * @brief Attaches a congestion control algorithm to a socket and resets its window
+ * @param sock MIC-TCP socket
+ * @param algorithm Algorithm to use
+ */
+void congestion_init(mic_tcp_sock *sock, mic_tcp_congestion algorithm);
+
+/**
+ * @brief Gives the number of PDUs the sender may have in flight, sock->lock must be held
+ * @param sock MIC-TCP socket
+ * @return min(cwnd, SEND_WINDOW_SIZE)
+ */
+unsigned int congestion_window(mic_tcp_sock *sock);
+
+/**
+ * @brief Handles an ACK that acknowledges new data, sock->lock must be held
+ * @param sock MIC-TCP socket
+ * @param acked Number of PDUs newly acknowledged
+ * @param rtt_sample RTT measured from the ACK in microseconds, 0 if none
+ */
+void congestion_on_ack(mic_tcp_sock *sock, unsigned int acked, unsigned long rtt_sample);
+
+/**
+ * @brief Handles an ACK that does not move the window, sock->lock must be held
+ * @param sock MIC-TCP socket
+ * @return 1 if a loss was detected and recovery started (the PDU at send_base
+ *         should be retransmitted), 0 otherwise
+ */
+int congestion_on_duplicate_ack(mic_tcp_sock *sock);
+
+/**
+ * @brief Handles a loss reported by the receiver (NACK), sock->lock must be held
+ * @param sock MIC-TCP socket
+ * @return 1 if recovery started, 0 if the loss belongs to the current recovery
+ */
+int congestion_on_nack(mic_tcp_sock *sock);
+
+/**
+ * @brief Handles the expiry of the oldest in-flight PDU, sock->lock must be held
+ * @param sock MIC-TCP socket
+ */
+void congestion_on_timeout(mic_tcp_sock *sock);
+
+#endif
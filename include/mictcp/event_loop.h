@@ -0,0 +1,30 @@
+#ifndef MICTCP_EVENT_LOOP_H
+#define MICTCP_EVENT_LOOP_H
+
+#include "mictcp.h"
+
+/**
+ * @brief Hands the system socket of a MIC-TCP socket to the event loop
+ *
+ * The event loop threads are started on the first registration. A socket is
+ * always served by the same loop thread, so its PDUs are never processed
+ * concurrently.
+ *
+ * @param sock MIC-TCP socket owning its system socket
+ * @param mode SERVER to dispatch PDUs to process_server_PDU, CLIENT for
+ *             process_client_PDU and the retransmission timers
+ * @return 0 on success, -1 on failure
+ */
+int event_loop_register(mic_tcp_sock *sock, start_mode mode);
+
+/**
+ * @brief Removes a system socket from the event loop
+ *
+ * When it returns, the loop thread no longer references the socket and the
+ * system socket may be closed.
+ *
+ * @param sock MIC-TCP socket previously registered
+ */
+void event_loop_unregister(mic_tcp_sock *sock);
+
+#endif
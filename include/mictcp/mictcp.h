@@ -59,6 +59,135 @@ typedef struct mic_tcp_sock_addr
     unsigned short port;
 } mic_tcp_sock_addr;
 
+/*
+ * Emplacement de la fenêtre d'émission (PDU de données en vol)
+ */
+typedef struct send_window_slot
+{
+    unsigned int seq_num;      /* numéro de séquence du PDU */
+    char *data;                /* copie des données applicatives */
+    int size;                  /* taille des données */
+    int capacity;              /* taille allouée pour data */
+    unsigned long sent_time;   /* date du dernier envoi (µs) */
+    unsigned long first_sent_time; /* date du premier envoi (µs) */
+    int transmissions;         /* nombre d'envois effectués */
+    unsigned long deadline;    /* date au-delà de laquelle le PDU n'est plus réémis (µs), 0 sans échéance */
+    char reliable;             /* 1 si le PDU est réémis jusqu'à son acquittement, sans tolérance de perte */
+    char done;                 /* 1 si acquitté ou abandonné */
+    char loss_counted;         /* 1 si la perte du PDU a déjà alimenté l'estimation du taux de perte */
+} send_window_slot;
+
+/*
+ * Emplacement de la file de réordonnancement (PDU reçu hors séquence)
+ */
+typedef struct reorder_slot
+{
+    unsigned int seq_num;      /* numéro de séquence du PDU */
+    char *data;                /* copie des données reçues */
+    int size;                  /* taille des données */
+    int capacity;              /* taille allouée pour data */
+    char present;              /* 1 si le PDU attend que les précédents arrivent */
+} reorder_slot;
+
+/*
+ * Mesures de la phase de sondage de mic_tcp_connect, indexées par numéro de sonde
+ */
+typedef struct probe_results
+{
+    int count;                 /* nombre de sondes émises */
+    unsigned long *rtt;        /* RTT de chaque sonde (µs), 0 si non acquittée */
+    unsigned int *arrival;     /* date de traitement de chaque sonde par le pair (µs, horloge du pair) */
+    unsigned long max_rtt;     /* plus grand RTT mesuré (µs) */
+    unsigned long start;       /* date d'émission de la rafale (µs) */
+} probe_results;
+
+/*
+ * File de réception d'une connexion : anneau SPSC d'octets borné, remplie par
+ * le thread réseau et vidée par mic_tcp_recv
+ */
+typedef struct app_buffer
+{
+    char *data;            /* anneau de messages, chacun précédé de sa taille */
+    unsigned int head;     /* position du prochain message à lire (consommateur, octets) */
+    unsigned int tail;     /* position du prochain message à écrire (producteur, octets) */
+    int waiting;           /* 1 si le consommateur dort */
+    unsigned int wakeups;  /* compteur de réveils, mot du futex du consommateur */
+    int closed;            /* 1 une fois le FIN du pair reçu, plus aucune donnée à venir */
+} app_buffer;
+
+/*
+ * Modèle de perte d'un modèle de dégradation
+ */
+typedef enum mic_tcp_loss_model
+{
+    LOSS_NONE,             /* aucune perte */
+    LOSS_BERNOULLI,        /* pertes indépendantes de probabilité loss_rate */
+    LOSS_GILBERT_ELLIOTT   /* pertes en rafales : chaîne à deux états bon/mauvais */
+} mic_tcp_loss_model;
+
+/*
+ * Dégradation émulée du réseau, appliquée par IP_send aux datagrammes émis
+ * sur un socket système. Les probabilités sont en pourcentage.
+ */
+typedef struct mic_tcp_impairment
+{
+    unsigned long seed;               /* graine du générateur, même graine = mêmes décisions */
+    mic_tcp_loss_model loss_model;
+    float loss_rate;                  /* Bernoulli : probabilité de perte */
+    float ge_good_to_bad;             /* Gilbert-Elliott : probabilité de passer de l'état bon au mauvais */
+    float ge_bad_to_good;             /* Gilbert-Elliott : probabilité de revenir à l'état bon */
+    float ge_loss_good;               /* Gilbert-Elliott : probabilité de perte en état bon */
+    float ge_loss_bad;                /* Gilbert-Elliott : probabilité de perte en état mauvais */
+    unsigned long delay_usec;         /* délai fixe ajouté à chaque datagramme (µs) */
+    unsigned long jitter_usec;        /* gigue uniforme ajoutée au délai, dans [0, jitter_usec] (µs) */
+    float reorder_rate;               /* probabilité de retenir un datagramme pour qu'il soit doublé */
+    unsigned long reorder_delay_usec; /* retard supplémentaire d'un datagramme retenu (µs) */
+    float duplicate_rate;             /* probabilité d'émettre un datagramme en double */
+} mic_tcp_impairment;
+
+/*
+ * Algorithmes de contrôle de congestion, choisis par mic_tcp_set_congestion
+ */
+typedef enum mic_tcp_congestion
+{
+    CONGESTION_NEWRENO, /* AIMD : démarrage lent, évitement de congestion, fenêtre divisée par deux à la perte */
+    CONGESTION_DELAY    /* fondé sur le délai (Vegas) : garde une file d'attente courte, adapté aux médias */
+} mic_tcp_congestion;
+
+/*
+ * Statistiques d'un socket, rendues par mic_tcp_getstats
+ */
+#define MIC_TCP_LATENCY_BUCKETS 24
+
+typedef struct mic_tcp_stats
+{
+    unsigned long packets_sent;       /* PDUs de données émis, retransmissions comprises */
+    unsigned long bytes_sent;         /* octets de données émis, retransmissions comprises */
+    unsigned long packets_received;   /* PDUs de données reçus, doublons compris */
+    unsigned long bytes_received;     /* octets de données reçus, doublons compris */
+    unsigned long retransmissions;    /* PDUs de données réémis après expiration */
+    unsigned long losses_accepted;    /* PDUs abandonnés, la perte étant tolérée */
+    unsigned long deadlines_missed;   /* messages abandonnés ou non émis, leur échéance étant passée */
+    unsigned long duplicates;         /* PDUs de données déjà reçus */
+    unsigned long window_probes;      /* sondes émises vers un pair annonçant une fenêtre trop petite */
+    unsigned long out_of_order;       /* PDUs de données reçus hors séquence et mis en attente */
+    unsigned long sacked;             /* PDUs de données acquittés sélectivement (SACK) avant l'ACK cumulatif */
+    unsigned long timeouts;           /* expirations de temporisateurs de retransmission */
+    unsigned long fast_retransmits;   /* pertes détectées par ACKs dupliqués ou NACK, sans attendre le temporisateur */
+    unsigned long tail_probes;        /* sondes de fin de rafale (dernier PDU réémis avant la RTO) */
+    unsigned long acks_sent;          /* ACKs de données émis par le récepteur, après regroupement */
+    float measured_loss_rate;         /* taux de perte mesuré par mic_tcp_connect (%) */
+    float loss_estimate;              /* taux de perte estimé en continu pendant la connexion (%) */
+    int accepted_losses;              /* pertes tolérées sur loss_window transmissions, réglées par la politique de perte */
+    int loss_window;                  /* transmissions couvertes par la fenêtre de pertes */
+    unsigned long measured_rtt;       /* RTT médian des sondes de mic_tcp_connect (µs) */
+    unsigned long bandwidth_estimate; /* débit estimé par train de sondes (bit/s), 0 si inconnu */
+    unsigned long rto;                /* délai de retransmission courant (µs) */
+    unsigned int cwnd;                /* fenêtre de congestion (PDUs en vol) */
+    unsigned int ssthresh;            /* seuil de démarrage lent (PDUs) */
+    unsigned long latency_histogram[MIC_TCP_LATENCY_BUCKETS]; /* délais émission-ACK, case i : [2^i, 2^(i+1)[ µs */
+} mic_tcp_stats;
+
 /*
  * Structure d'un socket
  */
@@ -70,6 +199,8 @@ typedef struct mic_tcp_sock
     protocol_state state;          /* état du protocole */
     mic_tcp_sock_addr local_addr;  /* adresse locale du socket */
     mic_tcp_sock_addr remote_addr; /* adresse distante du socket */
+    struct sockaddr_in peer_addr;  /* adresse système du pair, résolue une fois par connexion */
+    char peer_host[INET_ADDRSTRLEN]; /* forme texte de peer_addr, pointée par remote_addr.ip_addr */
     unsigned int current_seq_num;  /* PSE/PSA numéro de séquence */
 
     // Connection asynchronism (server)
@@ -78,12 +209,72 @@ typedef struct mic_tcp_sock
 
     pthread_t listen_thread;       /* client-side listening thread */
 
+    // Retransmission timeout (RFC 6298)
+    unsigned long srtt;            /* RTT lissé (µs), 0 si aucune mesure */
+    unsigned long rttvar;          /* variance du RTT (µs) */
+    unsigned long rto_base;        /* délai de retransmission calculé, sans backoff (µs) */
+    unsigned long rto;             /* délai de retransmission courant, backoff compris (µs) */
+
     // Sliding window
-    int sliding_window;
+    unsigned long long *sliding_window; /* bitset circulaire des dernières transmissions, 1 = acquittée */
+    int sliding_window_head;       /* position de la prochaine transmission dans sliding_window */
+    int sliding_window_successes;  /* nombre de bits à 1 dans sliding_window */
     int sliding_window_consecutive_loss;
     int sliding_window_size;
+    float loss_estimate;           /* taux de perte estimé en continu sur les PDUs émis (%) */
     int received_packets;
+    probe_results *probes;         /* mesures en cours de la phase de sondage, NULL en dehors */
+
+    // Send window (client)
+    send_window_slot *send_window; /* PDU en vol, indexés par seq_num % SEND_WINDOW_SIZE */
+    unsigned int send_base;        /* plus ancien PDU ni acquitté ni abandonné */
+    unsigned int peer_window;      /* place libre annoncée par le dernier ACK du pair (octets) */
+    unsigned int flight_footprint; /* place que les PDUs en vol occuperont chez le pair (octets) */
+    char window_blocked;           /* 1 si mic_tcp_send attend que le pair libère de la place */
+    unsigned long persist_time;    /* date de la dernière sonde de fenêtre nulle (µs) */
+    unsigned int persist_backoff;  /* sondes successives sans ouverture de la fenêtre */
+    char skip_pending;             /* 1 si un PDU a été abandonné et que le pair n'a pas encore acquitté au-delà */
+    unsigned long skip_time;       /* date du dernier PDU vide signalant l'abandon (µs), 0 si aucun */
+
+    // Congestion control (client)
+    const struct congestion_ops *congestion; /* algorithme attaché au socket */
+    unsigned int cwnd;             /* fenêtre de congestion (PDUs en vol) */
+    unsigned int ssthresh;         /* seuil de démarrage lent (PDUs) */
+    unsigned int cwnd_credit;      /* PDUs acquittés depuis la dernière croissance de cwnd */
+    unsigned int duplicate_acks;   /* ACKs consécutifs n'ayant pas avancé send_base */
+    unsigned int recovery_point;   /* current_seq_num à la dernière réduction de la fenêtre */
+    char in_recovery;              /* 1 tant que send_base n'a pas atteint recovery_point */
+    char tail_probe_sent;          /* 1 si une sonde de fin de rafale attend un ACK faisant avancer send_base */
+    char nack_pending;             /* 1 si le PDU send_base a été signalé manquant par un NACK */
+    unsigned long base_rtt;        /* plus petit RTT mesuré (µs) */
+    unsigned long latest_rtt;      /* dernier RTT mesuré (µs) */
+
+    // Receive queue (server)
+    app_buffer recv_buffer;        /* données reçues en attente de mic_tcp_recv */
+    reorder_slot *reorder_buffer;  /* PDUs reçus au-delà de current_seq_num, indexés par seq_num % SEND_WINDOW_SIZE */
+    int reorder_held;              /* PDUs en attente dans reorder_buffer */
+    unsigned int nack_seq;         /* dernier trou signalé par un NACK */
+    char nack_sent;                /* 1 si nack_seq est valide */
+    int ack_every;                 /* PDUs reçus dans l'ordre acquittés par un même ACK, 1 pour acquitter chacun */
+    int ack_pending;               /* PDUs reçus dans l'ordre dont l'ACK attend la fin du lot de réception */
+    unsigned int ack_echo;         /* timestamp du dernier de ces PDUs, renvoyé par l'ACK différé */
 
+    // Connection demultiplexing (server)
+    int *accept_backlog;           /* connexions établies en attente de mic_tcp_accept (socket d'écoute) */
+    unsigned int backlog_head;     /* prochaine connexion à rendre */
+    unsigned int backlog_count;    /* connexions établies dans la file */
+    unsigned int backlog_pending;  /* connexions en cours d'établissement ayant réservé une place */
+    int listener_fd;               /* socket d'écoute ayant créé la connexion, -1 sinon ou une fois terminée par le thread réseau */
+    char shares_sys_socket;        /* 1 si sys_socket appartient au socket d'écoute */
+    int timer_head;                /* première connexion à temporisateur armé (socket d'écoute), -1 si aucune */
+    int timer_next;                /* connexion suivante dans cette liste, -1 en fin de liste */
+    char timer_armed;              /* 1 si la connexion est dans la liste de son socket d'écoute */
+    unsigned long timer_deadline;  /* date d'expiration du temporisateur de la connexion (µs) */
+    int timer_attempts;            /* SYN+ACK renvoyés sans réponse */
+    char linger_release;           /* 1 si l'application a fermé la connexion, libérée par le thread réseau qui la termine */
+
+    // Statistics
+    mic_tcp_stats stats;           /* compteurs, incrémentés sans verrou (atomiques relâchés) */
 
 } mic_tcp_sock;
 
@@ -96,6 +287,17 @@ typedef struct mic_tcp_payload
     int size;   /* taille des données */
 } mic_tcp_payload;
 
+/*
+ * Bloc d'acquittement sélectif : PDUs [start, end[ reçus au-delà de ack_num
+ */
+#define MIC_TCP_SACK_BLOCKS 3
+
+typedef struct mic_tcp_sack_block
+{
+    unsigned int start; /* premier numéro de séquence reçu */
+    unsigned int end;   /* numéro suivant le dernier reçu, bloc vide si égal à start */
+} mic_tcp_sack_block;
+
 /*
  * Structure de l'entête d'un PDU MIC-TCP
  */
@@ -105,9 +307,14 @@ typedef struct mic_tcp_header
     unsigned short dest_port;   /* numéro de port de destination */
     unsigned int seq_num;       /* numéro de séquence */
     unsigned int ack_num;       /* numéro d'acquittement */
+    unsigned int timestamp;     /* date d'émission (µs, 32 bits de poids faible) */
+    unsigned int timestamp_echo; /* timestamp du PDU acquitté (0 si aucun) */
+    unsigned int window;        /* place libre dans la file de réception de l'émetteur d'un ACK (octets) */
+    mic_tcp_sack_block sack[MIC_TCP_SACK_BLOCKS]; /* PDUs mis en attente par l'émetteur d'un ACK */
     unsigned char syn;          /* flag SYN (valeur 1 si activé et 0 si non) */
     unsigned char ack;          /* flag ACK (valeur 1 si activé et 0 si non) */
     unsigned char fin;          /* flag FIN (valeur 1 si activé et 0 si non) */
+    unsigned char nack;         /* flag NACK d'un ACK : le PDU ack_num manque alors que des suivants sont arrivés */
 } mic_tcp_header;
 
 /*
@@ -119,13 +326,6 @@ typedef struct mic_tcp_pdu
     mic_tcp_payload payload; /* charge utile du PDU */
 } mic_tcp_pdu;
 
-typedef struct app_buffer
-{
-    mic_tcp_payload packet;
-    struct app_buffer *next;
-    unsigned short id;
-} app_buffer;
-
 /****************************
  * Fonctions de l'interface *
  ****************************/
@@ -145,10 +345,10 @@ int mic_tcp_socket(start_mode sm);
 int mic_tcp_bind(int socket, mic_tcp_sock_addr addr);
 
 /**
- * @brief Places socket in accepting state for incoming connections
- * @param socket Socket descriptor
+ * @brief Accepts an incoming connection, the three-way handshake runs in the network thread
+ * @param socket Listening socket descriptor
  * @param addr Pointer to store remote address
- * @return 0 on success, -1 on failure
+ * @return Descriptor of the new connection socket, -1 on failure
  */
 int mic_tcp_accept(int socket, mic_tcp_sock_addr *addr);
 
@@ -175,6 +375,61 @@ int send_connection_acknowledgement(mic_tcp_sock* socket);
  */
 int mic_tcp_send(int mic_sock, char *msg, int msg_size);
 
+/**
+ * @brief Sends application data that is useless past a deadline
+ *
+ * Behaves like mic_tcp_send, except that the message is never retransmitted
+ * once the deadline has passed: it is given up whatever the loss tolerance,
+ * and the receiver skips it. A message still waiting for room in the send
+ * window when the deadline passes is not sent at all. Both outcomes are
+ * counted in the deadlines_missed statistic.
+ *
+ * @param mic_sock Socket descriptor
+ * @param msg Data to send
+ * @param msg_size Size of data
+ * @param deadline_us Lifetime of the message in microseconds, from the call
+ * @return Number of bytes sent, 0 if the deadline passed before sending, -1 on error
+ */
+int mic_tcp_send_deadline(int mic_sock, char *msg, int msg_size, unsigned long deadline_us);
+
+/*
+ * Options d'envoi de mic_tcp_send_flags
+ */
+#define MIC_TCP_SEND_LOSSY    0x0 /* perte tolérée selon la politique de perte du socket */
+#define MIC_TCP_SEND_RELIABLE 0x1 /* réémis jusqu'à son acquittement, jamais abandonné */
+
+/**
+ * @brief Sends application data with a per-message reliability class
+ *
+ * A MIC_TCP_SEND_RELIABLE message is retransmitted until it is acknowledged
+ * and never counts against the loss tolerance. The other messages follow the
+ * lossy policy of mic_tcp_send, so the loss budget is spent on them only.
+ *
+ * @param mic_sock Socket descriptor
+ * @param msg Data to send
+ * @param msg_size Size of data
+ * @param flags MIC_TCP_SEND_* options
+ * @return Number of bytes sent, -1 on error
+ */
+int mic_tcp_send_flags(int mic_sock, char *msg, int msg_size, int flags);
+
+/**
+ * @brief Sends application data with both a deadline and a reliability class
+ *
+ * mic_tcp_send, mic_tcp_send_deadline and mic_tcp_send_flags are shorthands
+ * for this call. A MIC_TCP_SEND_RELIABLE message with a deadline is
+ * retransmitted whatever the loss tolerance, until it is acknowledged or its
+ * deadline passes.
+ *
+ * @param mic_sock Socket descriptor
+ * @param msg Data to send
+ * @param msg_size Size of data
+ * @param deadline_us Lifetime of the message in microseconds, from the call, 0 for none
+ * @param flags MIC_TCP_SEND_* options
+ * @return Number of bytes sent, 0 if the deadline passed before sending, -1 on error
+ */
+int mic_tcp_send_deadline_flags(int mic_sock, char *msg, int msg_size, unsigned long deadline_us, int flags);
+
 /**
  * @brief Receives application data from the socket
  * @param socket Socket descriptor
@@ -191,31 +446,131 @@ int mic_tcp_recv(int socket, char *msg, int max_msg_size);
  */
 int mic_tcp_close(int socket);
 
+/**
+ * @brief Reads the transport statistics of a socket
+ *
+ * The counters are read one by one without stopping the protocol, so they
+ * may be a few PDUs apart from each other.
+ *
+ * @param socket Socket descriptor
+ * @param stats Filled with the counters of the socket
+ * @return 0 on success, -1 if the socket does not exist
+ */
+int mic_tcp_getstats(int socket, struct mic_tcp_stats *stats);
+
+/**
+ * @brief Emulates a degraded network on the datagrams sent by a socket
+ *
+ * Accepted connections share the system socket of their listening socket:
+ * the model must be set on the listening socket, where it applies to every
+ * connection accepted on it. Setting it on an accepted connection fails.
+ *
+ * @param socket Socket descriptor
+ * @param model Impairment model, NULL to go back to the default loss rate
+ * @return 0 on success, -1 on failure
+ */
+int mic_tcp_set_impairment(int socket, const mic_tcp_impairment *model);
+
+/**
+ * @brief Sets the number of transmissions the loss tolerance is computed over
+ *
+ * The accepted losses of the loss policy scale with the window: a 500
+ * transmission window tolerates 50 losses where the default 10 transmission
+ * window tolerates 1. The recorded outcomes are reset.
+ *
+ * @param socket Socket descriptor
+ * @param size Window size, between 1 and LOSS_WINDOW_MAX transmissions
+ * @return 0 on success, -1 on failure
+ */
+int mic_tcp_set_loss_window(int socket, int size);
+
+/**
+ * @brief Chooses the congestion control algorithm of a socket
+ *
+ * NewReno is used by default. Changing the algorithm resets the congestion
+ * window to CONGESTION_INITIAL_WINDOW.
+ *
+ * @param socket Socket descriptor
+ * @param algorithm CONGESTION_NEWRENO or CONGESTION_DELAY
+ * @return 0 on success, -1 on failure
+ */
+int mic_tcp_set_congestion(int socket, mic_tcp_congestion algorithm);
+
+/**
+ * @brief Sets how many in-order PDUs a connection acknowledges with a single ACK
+ *
+ * Delayed ACKs are on by default (ACK_DELAY_PACKETS): an in-order PDU is
+ * acknowledged with the next ones, at the latest once the receive batch it
+ * came in is processed. Out-of-order PDUs, duplicates and PDUs filling a gap
+ * are always acknowledged at once. Set on a listening socket, the value is
+ * inherited by the connections it accepts.
+ *
+ * @param socket Socket descriptor
+ * @param packets PDUs per ACK, between 1 (every PDU acknowledged at once) and SEND_WINDOW_SIZE
+ * @return 0 on success, -1 on failure
+ */
+int mic_tcp_set_delayed_ack(int socket, int packets);
+
 /**
  * @brief Processes a received MIC-TCP PDU
  * @param sys_socket System-interal socket descriptor
  * @param pdu Received PDU
- * @param local_addr Local address
- * @param remote_addr Remote address
+ * @param remote_addr System address the PDU was received from
  */
-void process_server_PDU(int sys_socket, mic_tcp_pdu pdu, mic_tcp_ip_addr local_addr, mic_tcp_ip_addr remote_addr);
+void process_server_PDU(int sys_socket, mic_tcp_pdu pdu, struct sockaddr_in *remote_addr);
+
+/**
+ * @brief Sends the ACKs delayed by process_server_PDU, once a receive batch is processed
+ */
+void flush_delayed_acks(void);
+
+/**
+ * @brief Fires the expired timers of the connections accepted on a system socket
+ *
+ * Resends the SYN+ACK of connections still waiting for the final ACK of the
+ * handshake, and releases those whose peer never answered. Closes the
+ * connections whose peer stopped repeating its FIN for CLOSE_LINGER_USEC.
+ *
+ * @param sys_socket System socket of a listening socket
+ * @return Delay before the next timer expires in milliseconds, 0 if none is armed
+ */
+unsigned long server_check_timeouts(int sys_socket);
+
+/**
+ * @brief Hands an accepted connection the network thread still reaches over to it
+ *
+ * A connection closed by its peer keeps answering the repeated FINs of its
+ * peer, in case the FIN+ACK was lost, and is released on the final ACK or
+ * once it lingered CLOSE_LINGER_USEC. A connection whose FIN went unanswered
+ * is released at the next pass of the network thread.
+ *
+ * @param conn Connection socket the application closes
+ * @return 1 if the network thread will release the connection, 0 if the application releases it
+ */
+int server_linger_close(mic_tcp_sock *conn);
 
 /**
  * @brief Listens for incoming PDUs on the client side
- * @param sys_socket System socket descriptor
+ * @param fd MIC-TCP socket descriptor
  */
-void listening_client(int sys_socket);
+void listening_client(int fd);
 
 /**
  * @brief Processes a received PDU on the client side
  * @param sys_socket System socket descriptor
  * @param pdu Received PDU
- * @param local_addr Local address
- * @param remote_addr Remote address
+ * @param remote_addr System address the PDU was received from
  */
-void process_client_PDU(int sys_socket, mic_tcp_pdu pdu, mic_tcp_ip_addr local_addr, mic_tcp_ip_addr remote_addr);
+void process_client_PDU(int sys_socket, mic_tcp_pdu pdu, struct sockaddr_in *remote_addr);
 
 void socket_set_state(mic_tcp_sock* socket, protocol_state state);
 void socket_cleanup(mic_tcp_sock* sock);
 
+/**
+ * @brief Prints the average and largest batch sizes achieved by the core I/O of the process
+ *
+ * The counters cover every socket, the applications call it once they are done.
+ */
+void print_batch_stats(void);
+
 #endif
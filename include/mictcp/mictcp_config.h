@@ -2,11 +2,38 @@
 #define MICTCP_CONFIG_H
 
 #define MAX_ATTEMPTS 10              // Maximum connection attempts
-#define TIMEOUT 30                   // Timeout in milliseconds
+#define TIMEOUT 30                   // Initial retransmission timeout in milliseconds (before any RTT sample)
+#define RTO_MIN_USEC 1000            // Lower bound of the retransmission timeout in microseconds
+#define RTO_MAX_USEC 2000000         // Upper bound of the retransmission timeout (backoff included)
+#define RTO_CLOCK_GRANULARITY_USEC 100 // Minimum variance term of the retransmission timeout
 #define LOSS_RATE 2                  // Packet loss rate percentage
-#define MAX_SOCKETS 20               // Maximum number of sockets
+#define MAX_SOCKETS 65536            // Maximum number of sockets
+#define SOCKET_CHUNK_SIZE 256        // Sockets allocated at once when the socket table grows
+#define ACCEPT_BACKLOG 128           // Connections waiting for mic_tcp_accept on a listening socket
+#define CLOSE_LINGER_USEC (2 * RTO_MAX_USEC) // Time a connection closed by its peer keeps answering repeated FINs
+#ifndef EVENT_LOOP_THREADS
+#define EVENT_LOOP_THREADS 0         // epoll threads serving every socket, 0 for one network thread per socket
+#endif
+#ifndef LOG_LEVEL
+#define LOG_LEVEL 3                  // Most verbose log level compiled in (0: none, 1: errors ... 4: debug)
+#endif
+#define LOG_RING_SLOTS 1024          // Log records buffered per thread, must be a power of 2
+#define LOG_RECORD_SIZE 256          // Maximum size of a formatted log record
+#define SEND_WINDOW_SIZE 64          // Maximum number of in-flight data PDUs
+#define CONGESTION_INITIAL_WINDOW 10  // Congestion window of a new connection, in PDUs (RFC 6928)
+#define CONGESTION_DUPACK_THRESHOLD 3 // Duplicate ACKs signalling a loss
+#define TAIL_LOSS_PROBE_MIN_USEC 500  // Lower bound of the delay before the last PDU of a burst is probed
+#define ACK_DELAY_PACKETS 2           // In-order PDUs acknowledged by one ACK, unless mic_tcp_set_delayed_ack
+#define CONGESTION_DELAY_ALPHA 2      // Delay-based control: grow while fewer PDUs are queued on the path
+#define CONGESTION_DELAY_BETA 4       // Delay-based control: shrink while more PDUs are queued on the path
 #define MESURING_RELIABILITY_PACKET_NUMBER 100 // Number of packets for reliability measurement
 #define MESURING_PAYLOAD "mesure"    // Payload for reliability measurement
+#define PROBE_PAYLOAD_SIZE 512       // Size of a probe, padded after MESURING_PAYLOAD for the packet-train estimate
+
+#define LOSS_WINDOW_SIZE 10          // Transmissions covered by the loss window, unless mic_tcp_set_loss_window
+#define LOSS_WINDOW_MAX 65536        // Largest loss window accepted by mic_tcp_set_loss_window
+#define LOSS_ESTIMATE_WEIGHT 256     // Transmissions averaged by the live loss estimate (EWMA gain 1/N)
+#define LOSS_POLICY_HYSTERESIS 1.0   // Margin in percent past a policy threshold, above one EWMA step (100/N)
 
 // ANSI color codes for logging
 #define ANSI_COLOR_BLACK   "\x1B[30m"
@@ -0,0 +1,59 @@
+#ifndef MICTCP_LOG_H
+#define MICTCP_LOG_H
+
+#include "mictcp_config.h"
+
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+/*
+ * Levels above LOG_LEVEL expand to nothing: neither the call nor its
+ * arguments are compiled. Enabled levels only format the record on the
+ * calling thread, the blocking write is done by the log writer thread.
+ */
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) log_write(__VA_ARGS__)
+#else
+#define LOG_ERROR(...) do { } while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) log_write(__VA_ARGS__)
+#else
+#define LOG_WARN(...) do { } while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) log_write(__VA_ARGS__)
+#else
+#define LOG_INFO(...) do { } while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) log_write(__VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do { } while (0)
+#endif
+
+/**
+ * @brief Formats a log record into the ring of the calling thread
+ *
+ * Never blocks: when the ring is full, the record is dropped and counted.
+ * The log writer thread is started on the first call.
+ *
+ * @param format printf-like format string, the record is truncated to LOG_RECORD_SIZE
+ */
+void log_write(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+/**
+ * @brief Writes every pending record to stderr
+ *
+ * Registered with atexit, so the records of a terminating process are not lost.
+ */
+void log_flush(void);
+
+#endif
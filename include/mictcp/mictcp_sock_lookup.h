@@ -5,8 +5,12 @@
 
 // Socket storage structure
 typedef struct {
-    mic_tcp_sock sock;    // MIC-TCP socket
-    int is_used;          // 1 if slot is occupied, 0 if free
+    mic_tcp_sock sock;       // MIC-TCP socket
+    int is_used;             // 1 if slot is occupied, 0 if free
+    int next_free;           // Next fd of the free list, -1 at the end
+    int hash_next;           // Next fd of the same hash bucket, -1 at the end
+    int is_hashed;           // 1 while PDUs are dispatched to this socket
+    struct sockaddr_in peer; // Peer part of the hash key, sin_family is AF_UNSPEC while unbound
 } socket_entry_t;
 
 /**
@@ -17,13 +21,41 @@ typedef struct {
 mic_tcp_sock *get_socket_by_fd(int fd);
 
 /**
- * @brief Looks up a socket by system socket descriptor
+ * @brief Looks up the socket of a system socket that is not bound to a peer yet
  * @param sys_socket System socket descriptor
  * @return Pointer to socket or NULL if not found
  */
 mic_tcp_sock *get_socket_by_sys_fd(int sys_socket);
 
+/**
+ * @brief Looks up the socket owning a PDU received from a peer
+ * @param sys_socket System socket descriptor the PDU was received on
+ * @param peer System address of the sender
+ * @return Socket bound to this peer, else the unbound socket of sys_socket, NULL if none
+ */
+mic_tcp_sock *get_socket_by_peer(int sys_socket, const struct sockaddr_in *peer);
+
+/**
+ * @brief Binds a socket to its peer in the lookup hash
+ * @param sock MIC-TCP socket
+ * @param peer System address of the peer
+ */
+void socket_set_peer(mic_tcp_sock *sock, const struct sockaddr_in *peer);
+
+/**
+ * @brief Stops dispatching PDUs to a socket, its peer may then open a new connection
+ * @param sock MIC-TCP socket
+ */
+void socket_unhash(mic_tcp_sock *sock);
+
 int allocate_new_socket(int sys_socket);
+
+/**
+ * @brief Puts a closed socket back on the free list, its fd may be reused
+ * @param sock MIC-TCP socket
+ */
+void release_socket(mic_tcp_sock *sock);
+
 void init_socket_array(void);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,25 @@
+#ifndef MICTCP_STATS_H
+#define MICTCP_STATS_H
+
+#include "mictcp.h"
+
+/**
+ * @brief Adds a value to a counter of sock->stats, without lock
+ */
+#define STATS_ADD(sock, counter, value) \
+    __atomic_fetch_add(&(sock)->stats.counter, (value), __ATOMIC_RELAXED)
+
+/**
+ * @brief Records a send-to-ACK delay in the latency histogram of a socket
+ * @param sock MIC-TCP socket
+ * @param latency_usec Delay between the first transmission of a PDU and its acknowledgment
+ */
+void stats_record_latency(mic_tcp_sock *sock, unsigned long latency_usec);
+
+/**
+ * @brief Logs a one-line summary of the statistics of a socket
+ * @param sock MIC-TCP socket
+ */
+void stats_log(mic_tcp_sock *sock);
+
+#endif
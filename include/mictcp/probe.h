@@ -0,0 +1,32 @@
+#ifndef MICTCP_PROBE_H
+#define MICTCP_PROBE_H
+
+#include "mictcp.h"
+
+/**
+ * @brief Measures the channel of a new connection with a burst of probes
+ *
+ * Sends MESURING_RELIABILITY_PACKET_NUMBER numbered probes back to back and
+ * waits for their acknowledgments for about two RTTs. Fills the loss rate,
+ * RTT and bandwidth estimate of sock->stats and seeds the RTO.
+ *
+ * @param sock MIC-TCP socket in the MEASURING_RELIABILITY state
+ * @return Measured loss rate in percent, -1 on failure
+ */
+float probe_run(mic_tcp_sock *sock);
+
+/**
+ * @brief Records the acknowledgment of a probe, called by the network thread
+ * @param sock MIC-TCP socket
+ * @param ack Acknowledgment, seq_num carries the number of the probe
+ */
+void probe_acknowledge(mic_tcp_sock *sock, mic_tcp_pdu *ack);
+
+/**
+ * @brief Tells whether a received data PDU is a connection probe
+ * @param pdu Received PDU
+ * @return 1 for a probe, 0 otherwise
+ */
+int probe_is_probe(mic_tcp_pdu *pdu);
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef MICTCP_REORDER_BUFFER_H
+#define MICTCP_REORDER_BUFFER_H
+
+#include "mictcp.h"
+
+/**
+ * @brief Allocates the reorder buffer of a connection
+ * @param sock MIC-TCP socket
+ * @return 0 on success, -1 on failure
+ */
+int reorder_buffer_init(mic_tcp_sock *sock);
+
+/**
+ * @brief Releases the reorder buffer of a connection
+ * @param sock MIC-TCP socket
+ */
+void reorder_buffer_free(mic_tcp_sock *sock);
+
+/**
+ * @brief Hands a received data PDU to the receive queue, in sequence order
+ *
+ * Skips the sequence numbers the sender gave up, queues the PDU if it is the
+ * next expected one or holds it until the gap before it fills, then delivers
+ * every held PDU that became in sequence. Called by the network thread.
+ *
+ * @param sock MIC-TCP socket in the ESTABLISHED state
+ * @param pdu Received data PDU (ack_num is the window base of the sender)
+ * @return 1 if the PDU revealed a new gap, to be reported by a NACK, 0 otherwise
+ */
+int reorder_buffer_receive(mic_tcp_sock *sock, mic_tcp_pdu *pdu);
+
+/**
+ * @brief Skips the sequence numbers the sender gave up and delivers the PDUs held after them
+ *
+ * Called by the network thread for every PDU carrying the window base of the
+ * sender: data PDUs, empty PDUs and the FIN.
+ *
+ * @param sock MIC-TCP socket
+ * @param base Window base of the sender (ack_num), nothing is skipped if it is not ahead
+ */
+void reorder_buffer_skip(mic_tcp_sock *sock, unsigned int base);
+
+/**
+ * @brief Describes the held PDUs as SACK blocks in an outgoing ACK
+ *
+ * The first block holds the PDU that triggered the ACK, the others follow in
+ * sequence order, up to MIC_TCP_SACK_BLOCKS.
+ *
+ * @param sock MIC-TCP socket
+ * @param ack ACK being built
+ * @param trigger Sequence number of the PDU that triggered the ACK
+ */
+void reorder_buffer_fill_sack(mic_tcp_sock *sock, mic_tcp_pdu *ack, unsigned int trigger);
+
+#endif
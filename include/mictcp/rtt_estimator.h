@@ -0,0 +1,55 @@
+#ifndef MICTCP_RTT_ESTIMATOR_H
+#define MICTCP_RTT_ESTIMATOR_H
+
+#include "mictcp.h"
+#include <time.h>
+
+/**
+ * @brief Resets the RTT estimation of a socket, the RTO starts at TIMEOUT
+ * @param sock MIC-TCP socket
+ */
+void rtt_init(mic_tcp_sock *sock);
+
+/**
+ * @brief Feeds a new RTT measurement and recomputes the RTO (RFC 6298)
+ * @param sock MIC-TCP socket
+ * @param sample_usec Measured RTT in microseconds, must not come from a retransmitted PDU (Karn)
+ */
+void rtt_update(mic_tcp_sock *sock, unsigned long sample_usec);
+
+/**
+ * @brief Measures the RTT from the timestamp echoed by an acknowledgment
+ * @param sock MIC-TCP socket
+ * @param pdu Acknowledgment carrying the echo of one of our timestamps
+ * @return Measured RTT in microseconds, 0 if the ACK carries no echo
+ */
+unsigned long rtt_update_from_echo(mic_tcp_sock *sock, mic_tcp_pdu *pdu);
+
+/**
+ * @brief Doubles the RTO after a timeout (exponential backoff)
+ * @param sock MIC-TCP socket
+ */
+void rtt_backoff(mic_tcp_sock *sock);
+
+/**
+ * @brief Cancels the backoff once new data is acknowledged
+ * @param sock MIC-TCP socket
+ */
+void rtt_reset_backoff(mic_tcp_sock *sock);
+
+/**
+ * @brief Gives the current RTO rounded up to the millisecond
+ * @param sock MIC-TCP socket
+ * @return RTO in milliseconds (at least 1)
+ */
+unsigned long rtt_get_rto_msec(mic_tcp_sock *sock);
+
+/**
+ * @brief Computes the absolute deadline of a timed wait lasting factor * RTO
+ * @param sock MIC-TCP socket
+ * @param deadline Deadline for pthread_cond_timedwait (CLOCK_REALTIME)
+ * @param factor Number of RTOs to wait
+ */
+void rtt_deadline(mic_tcp_sock *sock, struct timespec *deadline, int factor);
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef MICTCP_SEND_WINDOW_H
+#define MICTCP_SEND_WINDOW_H
+
+#include "mictcp.h"
+
+/**
+ * @brief Allocates the send window of a socket, starting at its current sequence number
+ * @param sock MIC-TCP socket
+ * @return 0 on success, -1 on failure
+ */
+int send_window_init(mic_tcp_sock *sock);
+
+/**
+ * @brief Releases the send window of a socket
+ * @param sock MIC-TCP socket
+ */
+void send_window_free(mic_tcp_sock *sock);
+
+/**
+ * @brief Queues a message in the send window and transmits it, blocking while the window is full
+ * @param sock MIC-TCP socket
+ * @param msg Data to send
+ * @param msg_size Size of data
+ * @param deadline Date past which the message is not (re)transmitted (µs), 0 for none
+ * @param flags MIC_TCP_SEND_* options
+ * @return Number of bytes queued, 0 if the deadline passed while waiting, -1 on error
+ */
+int send_window_push(mic_tcp_sock *sock, char *msg, int msg_size, unsigned long deadline, int flags);
+
+/**
+ * @brief Handles a cumulative acknowledgment: every PDU below its ack_num is acknowledged,
+ *        as well as the PDUs reported by its SACK blocks
+ * @param sock MIC-TCP socket
+ * @param ack Received ACK (ack_num is the next sequence number expected by the receiver)
+ */
+void send_window_acknowledge(mic_tcp_sock *sock, mic_tcp_pdu *ack);
+
+/**
+ * @brief Retransmits or gives up (loss tolerance, deadline) every in-flight PDU whose timer expired
+ *
+ * Reliable PDUs are always retransmitted. Also probes a peer whose receive
+ * window is too small for the next message while nothing is in flight.
+ *
+ * @param sock MIC-TCP socket
+ */
+void send_window_check_timeouts(mic_tcp_sock *sock);
+
+/**
+ * @brief Computes the delay before the next retransmission timer expires
+ * @param sock MIC-TCP socket
+ * @return Delay in milliseconds (at least 1)
+ */
+unsigned long send_window_next_timeout(mic_tcp_sock *sock);
+
+/**
+ * @brief Waits until every in-flight PDU has been acknowledged or given up
+ * @param sock MIC-TCP socket
+ * @return 0 if the window is empty, -1 if the peer stopped responding
+ */
+int send_window_flush(mic_tcp_sock *sock);
+
+#endif
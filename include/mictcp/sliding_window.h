@@ -12,6 +12,19 @@ extern int sliding_window_size;
 #define SLIDING_WINDOW_SIZE sliding_window_size
 #define SLIDING_WINDOW_CONSECUTIVE_ACCEPTABLE_LOSS sliding_window_consecutive_loss
 
+/**
+ * @brief Allocates an empty loss window, replacing the previous one
+ * @param sock MIC-TCP socket
+ * @param size Number of transmissions covered, at most LOSS_WINDOW_MAX
+ * @return 0 on success, -1 on failure
+ */
+int loss_window_init(mic_tcp_sock *sock, int size);
+
+/**
+ * @brief Releases the loss window of a socket
+ */
+void loss_window_free(mic_tcp_sock *sock);
+
 /**
  * @brief Updates the sliding window based on packet reception status
  * @param received 1 if packet was received successfully, 0 otherwise
@@ -24,4 +37,23 @@ void update_sliding_window(mic_tcp_sock *sock, char received);
  */
 char verify_acceptable_loss(mic_tcp_sock *sock);
 
+/**
+ * @brief Looks up the number of losses the default policy accepts per window
+ * @param loss_rate Loss rate in percent
+ * @param window_size Transmissions covered by the loss window
+ * @return Accepted losses out of window_size, -1 if the channel is too unreliable
+ */
+int loss_policy_accepted_losses(float loss_rate, int window_size);
+
+/**
+ * @brief Feeds the outcome of a transmission to the live loss estimate
+ *
+ * Updates the EWMA of the loss rate and moves the accepted losses to the
+ * neighbouring policy level once the estimate is LOSS_POLICY_HYSTERESIS past
+ * the threshold. sock->lock must be held.
+ *
+ * @param lost 1 if the PDU was found lost (once per PDU), 0 if it was acknowledged
+ */
+void loss_estimate_update(mic_tcp_sock *sock, char lost);
+
 #endif
\ No newline at end of file
@@ -1,30 +1,24 @@
+#define _GNU_SOURCE
 #include <api/mictcp_core.h>
+#include <api/mictcp_impairment.h>
+#include <mictcp/mictcp_log.h>
 #include <sys/time.h>
-#include <sys/queue.h>
 #include <math.h>
 #include <time.h>
 #include <pthread.h>
 #include <strings.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 
 /*****************
  * API Variables *
  *****************/
 int initialized = -1;
-pthread_t listen_th;
-pthread_mutex_t lock;
 unsigned short loss_rate = 0;
-struct sockaddr_in remote_addr;
-
-/* This is for the buffer */
-TAILQ_HEAD(tailhead, app_buffer_entry) app_buffer_head;
-struct tailhead *headp;
-struct app_buffer_entry {
-     mic_tcp_payload bf;
-     TAILQ_ENTRY(app_buffer_entry) entries;
-};
-
-/* Condition variable used for passive wait when buffer is empty */
-pthread_cond_t buffer_empty_cond;
 
 /*************************
  * Fonctions Utilitaires *
@@ -32,163 +26,317 @@ pthread_cond_t buffer_empty_cond;
 int initialize_components(start_mode mode)
 {
     int bnd, sys_socket;
-    struct hostent * hp;
     struct sockaddr_in local_addr;
-
-    if(initialized != -1) return initialized;
+    /* Un socket système par appel : chaque socket client a le sien, et le
+       serveur démultiplexe toutes ses connexions sur son socket d'écoute */
     if((sys_socket = socket(AF_INET, SOCK_DGRAM, 0)) == -1) return -1;
-    else initialized = 1;
 
-    if((mode == SERVER) & (initialized != -1))
-    {
-        TAILQ_INIT(&app_buffer_head);
-        pthread_cond_init(&buffer_empty_cond, 0);
-        memset((char *) &local_addr, 0, sizeof(local_addr));
-        local_addr.sin_family = AF_INET;
-        local_addr.sin_port = htons(API_CS_Port);
-        local_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-        bnd = bind(sys_socket, (struct sockaddr *) &local_addr, sizeof(local_addr));
-
-        if (bnd == -1)
-        {
-            initialized = -1;
-            close(sys_socket);
-        }
-        else
-        {
-            memset((char *) &remote_addr, 0, sizeof(remote_addr));
-            remote_addr.sin_family = AF_INET;
-            remote_addr.sin_port = htons(API_SC_Port);
-            hp = gethostbyname("localhost");
-            memcpy (&(remote_addr.sin_addr.s_addr), hp->h_addr, hp->h_length);
-            initialized = 1;
-        }
-    }
-    else
+    /* Le client prend un port éphémère pour que plusieurs émetteurs coexistent */
+    memset((char *) &local_addr, 0, sizeof(local_addr));
+    local_addr.sin_family = AF_INET;
+    local_addr.sin_port = htons(mode == SERVER ? API_CS_Port : 0);
+    local_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    bnd = bind(sys_socket, (struct sockaddr *) &local_addr, sizeof(local_addr));
+
+    if (bnd == -1)
     {
-        if(initialized != -1)
-        {
-            memset((char *) &remote_addr, 0, sizeof(remote_addr));
-            remote_addr.sin_family = AF_INET;
-            remote_addr.sin_port = htons(API_CS_Port);
-            hp = gethostbyname("localhost");
-            memcpy (&(remote_addr.sin_addr.s_addr), hp->h_addr, hp->h_length);
-
-            memset((char *) &local_addr, 0, sizeof(local_addr));
-            local_addr.sin_family = AF_INET;
-            local_addr.sin_port = htons(API_SC_Port);
-            local_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-            bnd = bind(sys_socket, (struct sockaddr *) &local_addr, sizeof(local_addr));
-        }
+        close(sys_socket);
+        return -1;
     }
+    initialized = 1;
 
-    if((initialized == 1) && (mode == SERVER))
-    {
-        pthread_create(&listen_th, NULL, listening, (void *)(long)sys_socket);
+    /* La réception côté serveur (thread listening ou boucle d'événements)
+       est démarrée par mic_tcp_socket */
+    return sys_socket;
+}
+
+int IP_resolve(mic_tcp_ip_addr addr, struct sockaddr_in* sys_addr)
+{
+    struct addrinfo hints;
+    struct addrinfo *res;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    /* Résolution unique du nom, le résultat est conservé par le socket */
+    if(addr.addr == NULL || getaddrinfo(addr.addr, NULL, &hints, &res) != 0) {
+        return -1;
     }
 
-    return initialized == 1 ? sys_socket : -1;
+    memcpy(sys_addr, res->ai_addr, sizeof(*sys_addr));
+    sys_addr->sin_port = htons(API_CS_Port);
+    freeaddrinfo(res);
+
+    return 0;
 }
 
-int IP_send(int sys_socket, mic_tcp_pdu pk, mic_tcp_ip_addr addr)
+/* Emission groupée : tant qu'une fenêtre d'émission est ouverte par le thread
+   (IP_send_batch_begin), les PDUs sont recopiés dans une file propre au
+   thread puis envoyés d'un seul sendmmsg par IP_send_batch_flush */
+typedef struct tx_batch_entry
 {
-    int result = -1;
-    int random = rand();
-    int lr_tresh = (int) round(((float)loss_rate/100.0)*RAND_MAX);
-    struct hostent * hp;
+    int sys_socket;
+    struct sockaddr_in addr;
+    mic_tcp_header header;
+    char payload[API_MTU];
+    int payload_size;
+} tx_batch_entry;
+
+static __thread int tx_batch_active = 0;
+static __thread int tx_batch_count = 0;
+static __thread tx_batch_entry tx_batch[API_BATCH_Size];
+
+/* Compteurs des tailles de lots atteintes, partagés par tous les threads */
+static unsigned long rx_batch_calls = 0;
+static unsigned long rx_batch_datagrams = 0;
+static unsigned long rx_batch_max = 0;
+static unsigned long tx_batch_calls = 0;
+static unsigned long tx_batch_datagrams = 0;
+static unsigned long tx_batch_max = 0;
+
+static void record_batch(unsigned long *calls, unsigned long *datagrams, unsigned long *max, unsigned long size)
+{
+    __atomic_fetch_add(calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(datagrams, size, __ATOMIC_RELAXED);
+    unsigned long current = __atomic_load_n(max, __ATOMIC_RELAXED);
+    while (size > current
+           && !__atomic_compare_exchange_n(max, &current, size, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
 
-    if(initialized == -1) {
-        result = -1;
-    } else {
-        mic_tcp_payload tmp = get_full_stream(pk);
-        int sent_size = tmp.size;
-
-        if(random > lr_tresh) {
-           hp = gethostbyname(addr.addr);
-           memcpy (&(remote_addr.sin_addr.s_addr), hp->h_addr, hp->h_length);
-           sent_size = sendto(sys_socket, tmp.data, tmp.size, 0, (struct sockaddr *)&remote_addr, sizeof(struct sockaddr));
-           printf("[MICTCP-CORE] Envoi d'un paquet IP de taille %d vers l'adresse %s\n", sent_size, addr.addr);
-        } else {
-           printf("[MICTCP-CORE] Perte du paquet\n");
+void IP_send_batch_begin()
+{
+    tx_batch_active = 1;
+}
+
+int IP_send_batch_flush()
+{
+    struct mmsghdr msgs[API_BATCH_Size];
+    struct iovec iovs[API_BATCH_Size][2];
+    int sent = 0;
+    int start = 0;
+
+    /* Un sendmmsg par suite d'entrées destinées au même socket système */
+    while (start < tx_batch_count) {
+        int end = start;
+        while (end < tx_batch_count && tx_batch[end].sys_socket == tx_batch[start].sys_socket) {
+            tx_batch_entry *entry = &tx_batch[end];
+            iovs[end][0].iov_base = &entry->header;
+            iovs[end][0].iov_len = API_HD_Size;
+            iovs[end][1].iov_base = entry->payload;
+            iovs[end][1].iov_len = entry->payload_size;
+
+            memset(&msgs[end], 0, sizeof(msgs[end]));
+            msgs[end].msg_hdr.msg_name = &entry->addr;
+            msgs[end].msg_hdr.msg_namelen = sizeof(entry->addr);
+            msgs[end].msg_hdr.msg_iov = iovs[end];
+            msgs[end].msg_hdr.msg_iovlen = entry->payload_size > 0 ? 2 : 1;
+            end++;
+        }
+
+        int done = 0;
+        while (done < end - start) {
+            int result = sendmmsg(tx_batch[start].sys_socket, &msgs[start + done], end - start - done, 0);
+            if (result <= 0) {
+                /* Les PDUs restants sont perdus, les temporisateurs de retransmission s'en chargent */
+                LOG_ERROR("[MICTCP-CORE] Echec de l'envoi groupe de %d paquets\n", end - start - done);
+                break;
+            }
+            record_batch(&tx_batch_calls, &tx_batch_datagrams, &tx_batch_max, result);
+            done += result;
+        }
+        sent += done;
+        start = end;
+    }
+
+    tx_batch_count = 0;
+    tx_batch_active = 0;
+    return sent;
+}
+
+/* Emission immédiate d'une copie du PDU, mise en file si un lot est ouvert */
+static int send_now(int sys_socket, mic_tcp_pdu pk, const struct sockaddr_in* addr)
+{
+    if(tx_batch_active && pk.payload.size <= API_MTU) {
+        if(tx_batch_count == API_BATCH_Size) {
+           IP_send_batch_flush();
+           tx_batch_active = 1;
         }
+        tx_batch_entry *entry = &tx_batch[tx_batch_count++];
+        entry->sys_socket = sys_socket;
+        entry->addr = *addr;
+        entry->header = pk.header;
+        entry->payload_size = pk.payload.size > 0 ? pk.payload.size : 0;
+        memcpy(entry->payload, pk.payload.data, entry->payload_size);
+        LOG_DEBUG("[MICTCP-CORE] Mise en file d'un paquet IP de taille %d vers l'adresse %s\n",
+                  API_HD_Size + entry->payload_size, inet_ntoa(addr->sin_addr));
+        return pk.payload.size;
+    }
+
+    /* L'entête et la charge utile sont envoyés sans recopie (scatter/gather) */
+    struct iovec iov[2];
+    iov[0].iov_base = &pk.header;
+    iov[0].iov_len = API_HD_Size;
+    iov[1].iov_base = pk.payload.data;
+    iov[1].iov_len = pk.payload.size;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = (void *) addr;
+    msg.msg_namelen = sizeof(*addr);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = pk.payload.size > 0 ? 2 : 1;
+
+    int sent_size = sendmsg(sys_socket, &msg, 0);
+    LOG_DEBUG("[MICTCP-CORE] Envoi d'un paquet IP de taille %d vers l'adresse %s\n", sent_size, inet_ntoa(addr->sin_addr));
+
+    /* Correct the sent size */
+    return (sent_size == -1) ? -1 : sent_size - API_HD_Size;
+}
+
+int IP_send(int sys_socket, mic_tcp_pdu pk, const struct sockaddr_in* addr)
+{
+    unsigned long delays[IMPAIRMENT_MAX_COPIES];
 
-        free (tmp.data);
+    if(initialized == -1 || addr == NULL) {
+        return -1;
+    }
 
-        /* Correct the sent size */
-        result = (sent_size == -1) ? -1 : sent_size - API_HD_Size;
+    /* Le modèle de dégradation du socket décide de la perte, de la
+       duplication et du délai de chaque copie du datagramme */
+    int copies = impairment_plan(sys_socket, loss_rate, delays);
+    if(copies == 0) {
+        LOG_DEBUG("[MICTCP-CORE] Perte du paquet\n");
+        return pk.payload.size;
     }
 
+    int result = pk.payload.size;
+    for(int i = 0; i < copies; i++) {
+        if(delays[i] > 0 && impairment_defer(sys_socket, addr, &pk, delays[i]) == 0) {
+            LOG_DEBUG("[MICTCP-CORE] Paquet retarde de %lu us\n", delays[i]);
+            continue;
+        }
+        if(send_now(sys_socket, pk, addr) == -1) {
+            result = -1;
+        }
+    }
     return result;
 }
 
-int IP_recv(int sys_socket, mic_tcp_pdu* pk, mic_tcp_ip_addr* local_addr, mic_tcp_ip_addr* remote_addr, unsigned long timeout)
+/* wait_ms : délai d'attente de poll, -1 pour attendre indéfiniment, 0 pour ne pas attendre */
+static int recv_batch(int sys_socket, mic_tcp_pdu* pks, struct sockaddr_in* remote_addrs, int count, int wait_ms)
 {
     int result = -1;
 
-    struct timeval tv;
-    struct sockaddr_in tmp_addr;
-    socklen_t tmp_addr_size = sizeof(struct sockaddr);
+    struct mmsghdr msgs[API_BATCH_Size];
+    struct iovec iovs[API_BATCH_Size][2];
 
     /* Send data over a fake IP */
     if(initialized == -1) {
         return -1;
     }
+    if(count > API_BATCH_Size) {
+        count = API_BATCH_Size;
+    }
 
-    /* Compute the number of entire seconds */
-    tv.tv_sec = timeout / 1000;
-    /* Convert the remainder to microseconds */
-    tv.tv_usec = (timeout - tv.tv_sec * 1000) * 1000;
-
-    /* Create a reception buffer */
-    int buffer_size = API_HD_Size + pk->payload.size;
-    char *buffer = malloc(buffer_size);
-
-    if ((setsockopt(sys_socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv))) >= 0) {
-       result = recvfrom(sys_socket, buffer, buffer_size, 0, (struct sockaddr *)&tmp_addr, &tmp_addr_size);
+    /* L'entête et la charge utile sont reçus directement dans les PDUs (pas de tampon intermédiaire) */
+    for(int i = 0; i < count; i++) {
+        iovs[i][0].iov_base = &(pks[i].header);
+        iovs[i][0].iov_len = API_HD_Size;
+        iovs[i][1].iov_base = pks[i].payload.data;
+        iovs[i][1].iov_len = pks[i].payload.size;
+
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_name = &remote_addrs[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(remote_addrs[i]);
+        msgs[i].msg_hdr.msg_iov = iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = (pks[i].payload.data != NULL && pks[i].payload.size > 0) ? 2 : 1;
     }
 
-    if (result != -1) {
-        /* Create the mic_tcp_pdu */
-        memcpy (&(pk->header), buffer, API_HD_Size);
-        pk->payload.size = result - API_HD_Size;
-        memcpy (pk->payload.data, buffer + API_HD_Size, pk->payload.size);
-
-        /* Generate a stub address */
-        if (remote_addr != NULL) {
-            remote_addr->addr = malloc(INET_ADDRSTRLEN);
-            remote_addr->addr_size = INET_ADDRSTRLEN;
-            inet_ntop(AF_INET, &(tmp_addr.sin_addr),remote_addr->addr,remote_addr->addr_size);
-            remote_addr->addr_size = strlen(remote_addr->addr) + 1; // don't forget '\0'
-        }
+    /* Lecture non bloquante d'abord : sous charge les datagrammes sont déjà là et
+       la réception d'un lot ne coûte qu'un appel système. Sinon on attend avec poll,
+       le délai (0 = infini) n'est plus reconfiguré sur le socket à chaque appel */
+    result = recvmmsg(sys_socket, msgs, count, MSG_DONTWAIT, NULL);
+    if (result == -1 && (errno == EAGAIN || errno == EWOULDBLOCK) && wait_ms != 0) {
+       struct pollfd pfd;
+       pfd.fd = sys_socket;
+       pfd.events = POLLIN;
+
+       int ready;
+       do {
+          ready = poll(&pfd, 1, wait_ms);
+       } while (ready == -1 && errno == EINTR);
+
+       if (ready > 0) {
+          result = recvmmsg(sys_socket, msgs, count, MSG_DONTWAIT, NULL);
+       }
+    }
 
-        if (local_addr != NULL) {
-            local_addr->addr = "localhost";
-            local_addr->addr_size = strlen(local_addr->addr) + 1; // don't forget '\0'
+    /* Rien à lire dans le délai imparti : ce n'est pas une erreur du socket */
+    if (result == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return 0;
+    }
+    if (result <= 0) {
+        return -1;
+    }
+    record_batch(&rx_batch_calls, &rx_batch_datagrams, &rx_batch_max, result);
+
+    /* Les datagrammes trop courts pour contenir un entête sont écartés,
+       les PDUs valides sont regroupés en tête du tableau */
+    int valid = 0;
+    for (int i = 0; i < result; i++) {
+        int size = msgs[i].msg_len;
+        if (size < API_HD_Size) {
+            continue;
         }
+        LOG_DEBUG("[MICTCP-CORE] Réception d'un paquet IP de taille %d provenant de %s\n", size,
+                  inet_ntoa(remote_addrs[i].sin_addr));
 
-        printf("[MICTCP-CORE] Réception d'un paquet IP de taille %d provenant de %s\n", result, remote_addr->addr);
+        if (valid != i) {
+            mic_tcp_pdu tmp_pdu = pks[valid];
+            pks[valid] = pks[i];
+            pks[i] = tmp_pdu;
 
-        /* Correct the receved size */
-        result -= API_HD_Size;
+            struct sockaddr_in tmp_addr = remote_addrs[valid];
+            remote_addrs[valid] = remote_addrs[i];
+            remote_addrs[i] = tmp_addr;
+        }
+        /* Complete the mic_tcp_pdu */
+        pks[valid].payload.size = size - API_HD_Size;
+        valid++;
     }
 
-    /* Free the reception buffer */
-    free(buffer);
+    return valid;
+}
 
-    return result;
+int IP_recv_batch(int sys_socket, mic_tcp_pdu* pks, struct sockaddr_in* remote_addrs, int count, unsigned long timeout)
+{
+    return recv_batch(sys_socket, pks, remote_addrs, count, timeout == 0 ? -1 : (int) timeout);
 }
 
-mic_tcp_payload get_full_stream(mic_tcp_pdu pk)
+int IP_try_recv_batch(int sys_socket, mic_tcp_pdu* pks, struct sockaddr_in* remote_addrs, int count)
 {
-    /* Get a full packet from data and header */
-    mic_tcp_payload tmp;
-    tmp.size = API_HD_Size + pk.payload.size;
-    tmp.data = malloc (tmp.size);
+    return recv_batch(sys_socket, pks, remote_addrs, count, 0);
+}
 
-    memcpy (tmp.data, &pk.header, API_HD_Size);
-    memcpy (tmp.data + API_HD_Size, pk.payload.data, pk.payload.size);
+int IP_recv(int sys_socket, mic_tcp_pdu* pk, struct sockaddr_in* remote_addr, unsigned long timeout)
+{
+    struct sockaddr_in tmp_addr;
 
-    return tmp;
+    if (IP_recv_batch(sys_socket, pk, remote_addr != NULL ? remote_addr : &tmp_addr, 1, timeout) != 1) {
+        return -1;
+    }
+    return pk->payload.size;
+}
+
+void IP_get_batch_stats(ip_batch_stats* stats)
+{
+    stats->rx_calls = __atomic_load_n(&rx_batch_calls, __ATOMIC_RELAXED);
+    stats->rx_datagrams = __atomic_load_n(&rx_batch_datagrams, __ATOMIC_RELAXED);
+    stats->rx_max_batch = __atomic_load_n(&rx_batch_max, __ATOMIC_RELAXED);
+    stats->tx_calls = __atomic_load_n(&tx_batch_calls, __ATOMIC_RELAXED);
+    stats->tx_datagrams = __atomic_load_n(&tx_batch_datagrams, __ATOMIC_RELAXED);
+    stats->tx_max_batch = __atomic_load_n(&tx_batch_max, __ATOMIC_RELAXED);
 }
 
 mic_tcp_payload get_mic_tcp_data(ip_payload buff)
@@ -208,101 +356,187 @@ mic_tcp_header get_mic_tcp_header(ip_payload packet)
     return tmp;
 }
 
-int app_buffer_get(mic_tcp_payload app_buff)
+static void futex_wait(unsigned int *addr, unsigned int expected)
+{
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+static void futex_wake(unsigned int *addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+/* Tampon applicatif : chaque connexion possède son anneau SPSC de
+   API_APP_BUFFER_Size octets. Le thread réseau est le seul producteur, le
+   thread applicatif le seul consommateur. Chaque message y occupe
+   API_APP_BUFFER_Footprint(taille) octets : sa taille sur 4 octets, puis ses
+   données complétées à un multiple de 4, si bien qu'une taille n'est jamais
+   coupée par la fin de l'anneau (les données peuvent l'être). Les positions
+   croissent librement et sont ramenées dans l'anneau par masque, elles ne
+   sont modifiées que par leur propriétaire (tail par le producteur, head par
+   le consommateur). La place libre est annoncée à l'émetteur dans chaque ACK.
+   Le consommateur ne dort (futex sur wakeups) que si l'anneau est vide, le
+   producteur ne le réveille que s'il dort */
+int app_buffer_init(app_buffer* buffer)
 {
-    /* A pointer to a buffer entry */
-    struct app_buffer_entry * entry;
+    buffer->data = malloc(API_APP_BUFFER_Size);
+    buffer->head = 0;
+    buffer->tail = 0;
+    buffer->waiting = 0;
+    buffer->wakeups = 0;
+    buffer->closed = 0;
+
+    if(buffer->data == NULL) {
+        return -1;
+    }
+    return 0;
+}
 
+void app_buffer_free(app_buffer* buffer)
+{
+    free(buffer->data);
+    buffer->data = NULL;
+}
+
+static void app_buffer_wake(app_buffer* buffer)
+{
+    __atomic_fetch_add(&buffer->wakeups, 1, __ATOMIC_SEQ_CST);
+    futex_wake(&buffer->wakeups);
+}
+
+void app_buffer_close(app_buffer* buffer)
+{
+    /* Wake the consumer so that it sees the end of the stream */
+    __atomic_store_n(&buffer->closed, 1, __ATOMIC_SEQ_CST);
+    app_buffer_wake(buffer);
+}
+
+/* Copies between the ring and a flat buffer, the data may wrap around the end */
+static void ring_read(const app_buffer* buffer, unsigned int position, char* to, int size)
+{
+    unsigned int offset = position & (API_APP_BUFFER_Size - 1);
+    int first = min_size(size, API_APP_BUFFER_Size - offset);
+    memcpy(to, buffer->data + offset, first);
+    memcpy(to + first, buffer->data, size - first);
+}
+
+static void ring_write(app_buffer* buffer, unsigned int position, const char* from, int size)
+{
+    unsigned int offset = position & (API_APP_BUFFER_Size - 1);
+    int first = min_size(size, API_APP_BUFFER_Size - offset);
+    memcpy(buffer->data + offset, from, first);
+    memcpy(buffer->data, from + first, size - first);
+}
+
+int app_buffer_get(app_buffer* buffer, mic_tcp_payload app_buff)
+{
     /* The actual size passed to the application */
     int result = 0;
 
-    /* Lock a mutex to protect the buffer from corruption */
-    pthread_mutex_lock(&lock);
+    unsigned int head = __atomic_load_n(&buffer->head, __ATOMIC_RELAXED);
 
-    /* If the buffer is empty, we wait for insertion */
-    while(app_buffer_head.tqh_first == NULL) {
-          pthread_cond_wait(&buffer_empty_cond, &lock);
+    /* If the buffer is empty, we wait for insertion. The wakeup counter is
+       read before checking tail and closed one last time: a put or close
+       happening after that check bumps the counter, and the futex then
+       returns immediately instead of sleeping */
+    while(__atomic_load_n(&buffer->tail, __ATOMIC_ACQUIRE) == head) {
+        /* Empty and closed: end of stream */
+        if(__atomic_load_n(&buffer->closed, __ATOMIC_ACQUIRE)) {
+            return 0;
+        }
+        unsigned int wakeups = __atomic_load_n(&buffer->wakeups, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&buffer->waiting, 1, __ATOMIC_SEQ_CST);
+        if(__atomic_load_n(&buffer->tail, __ATOMIC_SEQ_CST) == head
+           && !__atomic_load_n(&buffer->closed, __ATOMIC_SEQ_CST)) {
+            futex_wait(&buffer->wakeups, wakeups);
+        }
+        __atomic_store_n(&buffer->waiting, 0, __ATOMIC_RELAXED);
     }
 
-    /* When we execute the code below, the following conditions are true:
-       - The buffer contains at least 1 element
-       - We hold the lock on the mutex
-    */
-
-    /* The entry we want is the first one in the buffer */
-    entry = app_buffer_head.tqh_first;
+    /* The message we want is the oldest one in the ring */
+    int size = *(int*) (buffer->data + (head & (API_APP_BUFFER_Size - 1)));
 
     /* How much data are we going to deliver to the application ? */
-    result = min_size(entry->bf.size, app_buff.size);
+    result = min_size(size, app_buff.size);
 
     /* We copy the actual data in the application allocated buffer */
-    memcpy(app_buff.data, entry->bf.data, result);
-
-    /* We remove the entry from the buffer */
-    TAILQ_REMOVE(&app_buffer_head, entry, entries);
+    ring_read(buffer, head + 4, app_buff.data, result);
 
-    /* Release the mutex */
-    pthread_mutex_unlock(&lock);
-
-    /* Clean up memory */
-    free(entry->bf.data);
-    free(entry);
+    /* The space is handed back to the producer */
+    __atomic_store_n(&buffer->head, head + API_APP_BUFFER_Footprint(size), __ATOMIC_RELEASE);
 
     return result;
 }
 
-void app_buffer_put(mic_tcp_payload bf)
+int app_buffer_put(app_buffer* buffer, mic_tcp_payload bf)
 {
-    /* Prepare a buffer entry to store the data */
-    struct app_buffer_entry * entry = malloc(sizeof(struct app_buffer_entry));
-    entry->bf.size = bf.size;
-    entry->bf.data = malloc(bf.size);
-    memcpy(entry->bf.data, bf.data, bf.size);
+    unsigned int tail = __atomic_load_n(&buffer->tail, __ATOMIC_RELAXED);
+    int size = min_size(bf.size, API_MTU);
 
-    /* Lock a mutex to protect the buffer from corruption */
-    pthread_mutex_lock(&lock);
+    /* Not enough room: the PDU is refused, the caller must not acknowledge it */
+    if(API_APP_BUFFER_Footprint(size) > app_buffer_space(buffer)) {
+        return -1;
+    }
 
-    /* Insert the packet in the buffer, at the end of it */
-    TAILQ_INSERT_TAIL(&app_buffer_head, entry, entries);
+    *(int*) (buffer->data + (tail & (API_APP_BUFFER_Size - 1))) = size;
+    ring_write(buffer, tail + 4, bf.data, size);
 
-    /* Release the mutex */
-    pthread_mutex_unlock(&lock);
+    /* Publish the message, then wake the consumer only if it is asleep */
+    __atomic_store_n(&buffer->tail, tail + API_APP_BUFFER_Footprint(size), __ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&buffer->waiting, __ATOMIC_SEQ_CST)) {
+        app_buffer_wake(buffer);
+    }
 
-    /* We can now signal to any potential thread waiting that the buffer is
-       no longer empty */
-    pthread_cond_broadcast(&buffer_empty_cond);
+    return 0;
+}
+
+unsigned int app_buffer_space(app_buffer* buffer)
+{
+    /* Only called by the producer: tail is its own, head may only grow meanwhile */
+    unsigned int used = __atomic_load_n(&buffer->tail, __ATOMIC_RELAXED)
+                        - __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+    return API_APP_BUFFER_Size - used;
 }
 
 void* listening(void* arg)
 {
     int sys_socket = (int)(long)arg;
-    mic_tcp_pdu pdu_tmp;
-    int recv_size;
-    mic_tcp_ip_addr remote;
-    mic_tcp_ip_addr local;
-
-    pthread_mutex_init(&lock, NULL);
+    mic_tcp_pdu pdu_tmp[API_BATCH_Size];
+    struct sockaddr_in remote[API_BATCH_Size];
+    int recv_count;
+    unsigned long timeout = 0;
 
-    printf("[MICTCP-CORE] Demarrage du thread de reception reseau...\n");
+    LOG_INFO("[MICTCP-CORE] Demarrage du thread de reception reseau...\n");
 
-    const int payload_size = 1500 - API_HD_Size;
-    pdu_tmp.payload.size = payload_size;
-    pdu_tmp.payload.data = malloc(payload_size);
-
-    remote.addr = malloc(100);
-    remote.addr_size = 100;
+    const int payload_size = API_MTU - API_HD_Size;
+    for(int i = 0; i < API_BATCH_Size; i++) {
+        pdu_tmp[i].payload.data = malloc(payload_size);
+    }
 
     while(1)
     {
-        remote.addr_size = 100;
-        pdu_tmp.payload.size = payload_size;
-        recv_size = IP_recv(sys_socket, &pdu_tmp, &local, &remote, 0);
+        for(int i = 0; i < API_BATCH_Size; i++) {
+            pdu_tmp[i].payload.size = payload_size;
+        }
+        /* Réveil au plus tard à l'expiration du prochain temporisateur des connexions */
+        recv_count = IP_recv_batch(sys_socket, pdu_tmp, remote, API_BATCH_Size, timeout);
 
-        if(recv_size != -1)
+        if(recv_count != -1)
         {
-            process_server_PDU(sys_socket, pdu_tmp, local, remote);
+            /* Les ACKs du lot partent ensemble une fois tout le lot traité */
+            IP_send_batch_begin();
+            for(int i = 0; i < recv_count; i++) {
+                process_server_PDU(sys_socket, pdu_tmp[i], &remote[i]);
+            }
+            /* Les ACKs différés n'attendent pas au-delà du lot */
+            flush_delayed_acks();
+            timeout = server_check_timeouts(sys_socket);
+            IP_send_batch_flush();
         } else {
             // socket closed
+            for(int i = 0; i < API_BATCH_Size; i++) {
+                free(pdu_tmp[i].payload.data);
+            }
             return NULL;
         }
     }
@@ -0,0 +1,406 @@
+#define _GNU_SOURCE
+#include <api/mictcp_impairment.h>
+#include <mictcp/mictcp_log.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/uio.h>
+
+/*
+ * Chaque socket système peut recevoir son propre modèle de dégradation, avec
+ * son propre générateur pseudo-aléatoire (xorshift64*) initialisé par la
+ * graine du modèle : une même graine et une même suite de datagrammes donnent
+ * les mêmes pertes, doublons et délais. Les sockets sans modèle gardent la
+ * perte de Bernoulli de set_loss_rate, tirée par un générateur propre à
+ * chaque thread.
+ *
+ * Les datagrammes retardés sont recopiés dans un tas trié par date
+ * d'émission, vidé par un thread dédié démarré au premier retard.
+ */
+
+typedef struct impairment_state
+{
+    mic_tcp_impairment model;
+    uint64_t rng;                 /* état du générateur du modèle */
+    int bad_state;                /* Gilbert-Elliott : 1 en état mauvais */
+    pthread_mutex_t lock;         /* IP_send peut être appelé par plusieurs threads */
+} impairment_state;
+
+typedef struct deferred_datagram
+{
+    unsigned long due_usec;       /* date d'émission, horloge monotone (µs) */
+    unsigned long order;          /* rang d'arrivée, départage les dates égales */
+    int sys_socket;
+    struct sockaddr_in addr;
+    mic_tcp_header header;
+    int payload_size;
+    char payload[API_MTU];
+} deferred_datagram;
+
+/* Modèles indexés par socket système, protégés par states_lock */
+static impairment_state** states = NULL;
+static int state_capacity = 0;
+static int state_count = 0;
+static pthread_rwlock_t states_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static __thread uint64_t default_rng = 0;
+
+/* File d'émission différée, protégée par queue_lock */
+static deferred_datagram** heap = NULL;
+static int heap_size = 0;
+static int heap_capacity = 0;
+static unsigned long next_order = 0;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond;
+static pthread_once_t queue_once = PTHREAD_ONCE_INIT;
+static int queue_started = 0;
+
+/*************************
+ * Générateur aléatoire  *
+ *************************/
+
+static uint64_t rng_seed(uint64_t seed)
+{
+    /* splitmix64 : deux graines voisines donnent des états sans rapport */
+    uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return z ? z : 0x9E3779B97F4A7C15ULL;
+}
+
+static uint64_t rng_next(uint64_t* state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+/* Tire un événement de probabilité percent (%) */
+static int rng_chance(uint64_t* state, float percent)
+{
+    if(percent <= 0) {
+        return 0;
+    }
+    double uniform = (rng_next(state) >> 11) * (1.0 / 9007199254740992.0);
+    return uniform * 100.0 < percent;
+}
+
+/* Tire un entier uniforme dans [0, bound] */
+static unsigned long rng_upto(uint64_t* state, unsigned long bound)
+{
+    return bound ? rng_next(state) % (bound + 1) : 0;
+}
+
+static unsigned long monotonic_usec(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long) now.tv_sec * 1000000UL + now.tv_nsec / 1000;
+}
+
+/*************************
+ * Modèles par socket    *
+ *************************/
+
+static int plan_with_model(impairment_state* state, unsigned long* delays)
+{
+    mic_tcp_impairment* model = &state->model;
+    int lost = 0;
+
+    switch(model->loss_model) {
+        case LOSS_BERNOULLI:
+            lost = rng_chance(&state->rng, model->loss_rate);
+            break;
+        case LOSS_GILBERT_ELLIOTT:
+            /* La perte dépend de l'état courant, puis la chaîne change d'état */
+            lost = rng_chance(&state->rng, state->bad_state ? model->ge_loss_bad : model->ge_loss_good);
+            if(state->bad_state) {
+                state->bad_state = !rng_chance(&state->rng, model->ge_bad_to_good);
+            } else {
+                state->bad_state = rng_chance(&state->rng, model->ge_good_to_bad);
+            }
+            break;
+        case LOSS_NONE:
+            break;
+    }
+    if(lost) {
+        return 0;
+    }
+
+    int copies = rng_chance(&state->rng, model->duplicate_rate) ? 2 : 1;
+    for(int i = 0; i < copies; i++) {
+        delays[i] = model->delay_usec + rng_upto(&state->rng, model->jitter_usec);
+        if(rng_chance(&state->rng, model->reorder_rate)) {
+            delays[i] += model->reorder_delay_usec;
+        }
+    }
+    return copies;
+}
+
+int impairment_plan(int sys_socket, unsigned short default_loss_rate, unsigned long* delays)
+{
+    /* Aucun verrou tant qu'aucun modèle n'est installé */
+    if(__atomic_load_n(&state_count, __ATOMIC_RELAXED) > 0) {
+        pthread_rwlock_rdlock(&states_lock);
+        impairment_state* state = sys_socket >= 0 && sys_socket < state_capacity ? states[sys_socket] : NULL;
+        if(state) {
+            pthread_mutex_lock(&state->lock);
+            int copies = plan_with_model(state, delays);
+            pthread_mutex_unlock(&state->lock);
+            pthread_rwlock_unlock(&states_lock);
+            return copies;
+        }
+        pthread_rwlock_unlock(&states_lock);
+    }
+
+    if(default_rng == 0) {
+        default_rng = rng_seed(monotonic_usec() ^ (uint64_t) (uintptr_t) &default_rng);
+    }
+    delays[0] = 0;
+    return rng_chance(&default_rng, default_loss_rate) ? 0 : 1;
+}
+
+/* Retire le modèle de sys_socket, states_lock doit être pris en écriture */
+static void remove_model(int sys_socket)
+{
+    if(sys_socket < 0 || sys_socket >= state_capacity || !states[sys_socket]) {
+        return;
+    }
+    pthread_mutex_destroy(&states[sys_socket]->lock);
+    free(states[sys_socket]);
+    states[sys_socket] = NULL;
+    __atomic_fetch_sub(&state_count, 1, __ATOMIC_RELAXED);
+}
+
+int IP_set_impairment(int sys_socket, const mic_tcp_impairment* model)
+{
+    if(sys_socket < 0) {
+        return -1;
+    }
+
+    pthread_rwlock_wrlock(&states_lock);
+    remove_model(sys_socket);
+    if(!model) {
+        pthread_rwlock_unlock(&states_lock);
+        return 0;
+    }
+
+    if(sys_socket >= state_capacity) {
+        int capacity = state_capacity ? state_capacity : 64;
+        while(capacity <= sys_socket) {
+            capacity *= 2;
+        }
+        impairment_state** grown = realloc(states, capacity * sizeof(impairment_state*));
+        if(!grown) {
+            pthread_rwlock_unlock(&states_lock);
+            return -1;
+        }
+        memset(grown + state_capacity, 0, (capacity - state_capacity) * sizeof(impairment_state*));
+        states = grown;
+        state_capacity = capacity;
+    }
+
+    impairment_state* state = calloc(1, sizeof(impairment_state));
+    if(!state) {
+        pthread_rwlock_unlock(&states_lock);
+        return -1;
+    }
+    state->model = *model;
+    state->rng = rng_seed(model->seed);
+    pthread_mutex_init(&state->lock, NULL);
+    states[sys_socket] = state;
+    __atomic_fetch_add(&state_count, 1, __ATOMIC_RELAXED);
+    pthread_rwlock_unlock(&states_lock);
+    return 0;
+}
+
+/*************************
+ * Emission différée     *
+ *************************/
+
+static int heap_before(const deferred_datagram* a, const deferred_datagram* b)
+{
+    return a->due_usec < b->due_usec || (a->due_usec == b->due_usec && a->order < b->order);
+}
+
+static void heap_sift_up(int index)
+{
+    while(index > 0) {
+        int parent = (index - 1) / 2;
+        if(!heap_before(heap[index], heap[parent])) {
+            break;
+        }
+        deferred_datagram* tmp = heap[parent];
+        heap[parent] = heap[index];
+        heap[index] = tmp;
+        index = parent;
+    }
+}
+
+static void heap_sift_down(int index)
+{
+    while(1) {
+        int smallest = index;
+        int left = 2 * index + 1;
+        int right = left + 1;
+        if(left < heap_size && heap_before(heap[left], heap[smallest])) {
+            smallest = left;
+        }
+        if(right < heap_size && heap_before(heap[right], heap[smallest])) {
+            smallest = right;
+        }
+        if(smallest == index) {
+            return;
+        }
+        deferred_datagram* tmp = heap[smallest];
+        heap[smallest] = heap[index];
+        heap[index] = tmp;
+        index = smallest;
+    }
+}
+
+static void send_deferred(deferred_datagram* datagram)
+{
+    struct iovec iov[2];
+    iov[0].iov_base = &datagram->header;
+    iov[0].iov_len = API_HD_Size;
+    iov[1].iov_base = datagram->payload;
+    iov[1].iov_len = datagram->payload_size;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &datagram->addr;
+    msg.msg_namelen = sizeof(datagram->addr);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = datagram->payload_size > 0 ? 2 : 1;
+
+    int sent_size = sendmsg(datagram->sys_socket, &msg, 0);
+    (void) sent_size;
+    LOG_DEBUG("[MICTCP-CORE] Envoi differe d'un paquet IP de taille %d vers l'adresse %s\n",
+              sent_size, inet_ntoa(datagram->addr.sin_addr));
+}
+
+static void* delay_thread(void* arg)
+{
+    (void) arg;
+
+    pthread_mutex_lock(&queue_lock);
+    while(1) {
+        if(heap_size == 0) {
+            pthread_cond_wait(&queue_cond, &queue_lock);
+            continue;
+        }
+
+        deferred_datagram* next = heap[0];
+        unsigned long now = monotonic_usec();
+        if(next->due_usec > now) {
+            struct timespec deadline;
+            deadline.tv_sec = next->due_usec / 1000000;
+            deadline.tv_nsec = (next->due_usec % 1000000) * 1000;
+            pthread_cond_timedwait(&queue_cond, &queue_lock, &deadline);
+            continue;
+        }
+
+        heap[0] = heap[--heap_size];
+        heap_sift_down(0);
+        /* Emis sous le verrou : IP_clear_impairment attend la fin de l'envoi */
+        send_deferred(next);
+        free(next);
+    }
+    return NULL;
+}
+
+static void start_delay_thread(void)
+{
+    pthread_condattr_t attr;
+    pthread_t thread;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&queue_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if(pthread_create(&thread, NULL, delay_thread, NULL) == 0) {
+        pthread_detach(thread);
+        queue_started = 1;
+    } else {
+        LOG_ERROR("[MICTCP-CORE] Echec du demarrage du thread d'emission differee\n");
+    }
+}
+
+int impairment_defer(int sys_socket, const struct sockaddr_in* addr, const mic_tcp_pdu* pk, unsigned long delay_usec)
+{
+    if(pk->payload.size > API_MTU) {
+        return -1;
+    }
+    pthread_once(&queue_once, start_delay_thread);
+    if(!queue_started) {
+        return -1;
+    }
+
+    deferred_datagram* datagram = malloc(sizeof(deferred_datagram));
+    if(!datagram) {
+        return -1;
+    }
+    datagram->due_usec = monotonic_usec() + delay_usec;
+    datagram->sys_socket = sys_socket;
+    datagram->addr = *addr;
+    datagram->header = pk->header;
+    datagram->payload_size = pk->payload.size > 0 ? pk->payload.size : 0;
+    memcpy(datagram->payload, pk->payload.data, datagram->payload_size);
+
+    pthread_mutex_lock(&queue_lock);
+    if(heap_size == heap_capacity) {
+        int capacity = heap_capacity ? 2 * heap_capacity : 256;
+        deferred_datagram** grown = realloc(heap, capacity * sizeof(deferred_datagram*));
+        if(!grown) {
+            pthread_mutex_unlock(&queue_lock);
+            free(datagram);
+            return -1;
+        }
+        heap = grown;
+        heap_capacity = capacity;
+    }
+    datagram->order = next_order++;
+    heap[heap_size] = datagram;
+    heap_sift_up(heap_size++);
+    /* Le thread se réveille si ce datagramme passe en tête */
+    if(heap[0] == datagram) {
+        pthread_cond_signal(&queue_cond);
+    }
+    pthread_mutex_unlock(&queue_lock);
+    return 0;
+}
+
+void IP_clear_impairment(int sys_socket)
+{
+    pthread_rwlock_wrlock(&states_lock);
+    remove_model(sys_socket);
+    pthread_rwlock_unlock(&states_lock);
+
+    /* Les datagrammes encore retenus ne doivent pas partir sur un descripteur réutilisé */
+    pthread_mutex_lock(&queue_lock);
+    int kept = 0;
+    for(int i = 0; i < heap_size; i++) {
+        if(heap[i]->sys_socket == sys_socket) {
+            free(heap[i]);
+        } else {
+            heap[kept++] = heap[i];
+        }
+    }
+    if(kept != heap_size) {
+        heap_size = kept;
+        for(int i = heap_size / 2 - 1; i >= 0; i--) {
+            heap_sift_down(i);
+        }
+        if(queue_started) {
+            pthread_cond_signal(&queue_cond);
+        }
+    }
+    pthread_mutex_unlock(&queue_lock);
+}
@@ -45,6 +45,7 @@ int main(int argc, char *argv[])
     }
 
     mic_tcp_close(sockfd);
+    print_batch_stats();
 
     return 0;
 }
@@ -20,6 +20,18 @@
 #define MICTCP_PORT 1337
 #define VIDEO_FILE "../video/video_wildlife.bin"
 
+/**
+ * En-tête RTP (RFC 3550) et types d'unités NAL H.264 (RFC 6184)
+ */
+#define RTP_HEADER_SIZE 12
+#define RTP_VERSION 2
+#define NAL_TYPE_MASK 0x1f
+#define NAL_TYPE_IDR 5          // tranche d'une image clé
+#define NAL_TYPE_SPS 7          // jeu de paramètres de séquence
+#define NAL_TYPE_PPS 8          // jeu de paramètres d'image
+#define NAL_TYPE_STAP_A 24      // agrégation de plusieurs NAL
+#define NAL_TYPE_FU_A 28        // fragment d'une NAL
+
 /**
  * Macro utilisée pour afficher le message d'erreur msg passé en paramètre
  * si la condition cond est validée, puis arrêter le programme.
@@ -64,6 +76,7 @@ static void file_to_faketcp(char* filename, char *host, int port);
 static void file_to_mictcp(char* filename);
 static void mictcp_to_udp(char *host, int port);
 static int read_rtp_packet(FILE *fd, struct timespec *timestamp, char *buffer, int buffer_size);
+static int rtp_send_flags(const unsigned char *packet, int size);
 static struct timespec tsSubtract(struct timespec time1, struct timespec time2);
 static void usage(void);
 
@@ -247,8 +260,8 @@ static void file_to_mictcp(char* filename)
         /* Mise à jour du timestamp */
         last_time = current_time;
 
-        /* Envoi du paquet rtp via mictcp */
-        int nb_sent = mic_tcp_send(sockfd, buffer, nb_read);
+        /* Envoi du paquet rtp via mictcp, fiable pour les images clés et les paramètres */
+        int nb_sent = mic_tcp_send_flags(sockfd, buffer, nb_read, rtp_send_flags((unsigned char *) buffer, nb_read));
         if (nb_sent < 0) {
             printf("ERROR on MICTCP send\n");
         }
@@ -258,6 +271,7 @@ static void file_to_mictcp(char* filename)
     if (mic_tcp_close(sockfd) == -1) {
         printf("ERROR on MICTCP close\n");
     }
+    print_batch_stats();
     fclose(filefd);
 }
 
@@ -297,14 +311,15 @@ static void mictcp_to_udp(char *host, int port)
 
     /* Acceptation d'une demande de connexion */
     mic_tcp_sock_addr mt_remote_addr;
-    if (mic_tcp_accept(mictcp_sockfd, &mt_remote_addr) == -1) {
+    int mictcp_connfd = mic_tcp_accept(mictcp_sockfd, &mt_remote_addr);
+    if (mictcp_connfd == -1) {
         printf("ERROR on accept on the MICTCP socket\n");
     }
 
     /* Lecture mictcp vers udp */
     char buff[MAX_UDP_SEGMENT_SIZE];    // buffer de lecture/ecriture
     while (1) {
-        int nb_read = mic_tcp_recv(mictcp_sockfd, buff, MAX_UDP_SEGMENT_SIZE);
+        int nb_read = mic_tcp_recv(mictcp_connfd, buff, MAX_UDP_SEGMENT_SIZE);
         if (nb_read <= 0) {
             if (nb_read < 0) {
                 printf("ERROR on mic_recv on the MICTCP socket\n");
@@ -317,9 +332,10 @@ static void mictcp_to_udp(char *host, int port)
     }
 
     /* Fermeture des sockets */
-    if (mic_tcp_close(mictcp_sockfd) == -1) {
+    if (mic_tcp_close(mictcp_connfd) == -1 || mic_tcp_close(mictcp_sockfd) == -1) {
         printf("ERROR on MICTCP close\n");
     }
+    print_batch_stats();
     close(udp_sockfd);
 }
 
@@ -345,6 +361,58 @@ static int read_rtp_packet(FILE *fd, struct timespec *timestamp, char *buffer, i
     return fread(buffer, 1, packet_size, fd);
 }
 
+/**
+ * Return 1 if a NAL unit type cannot be lost without breaking the decoding
+ * of the following images (keyframe slice, parameter sets)
+ */
+static int nal_is_critical(int nal_type)
+{
+    return nal_type == NAL_TYPE_IDR || nal_type == NAL_TYPE_SPS || nal_type == NAL_TYPE_PPS;
+}
+
+/**
+ * Parse the RTP header and the H.264 payload of a packet and return the
+ * mictcp send flags it deserves: MIC_TCP_SEND_RELIABLE for keyframes and
+ * parameter sets, MIC_TCP_SEND_LOSSY for the other slices.
+ * A packet that cannot be parsed is sent reliably.
+ */
+static int rtp_send_flags(const unsigned char *packet, int size)
+{
+    /* En-tête fixe, sources contributrices puis extension éventuelle */
+    if (size < RTP_HEADER_SIZE || (packet[0] >> 6) != RTP_VERSION) {
+        return MIC_TCP_SEND_RELIABLE;
+    }
+    int offset = RTP_HEADER_SIZE + 4 * (packet[0] & 0x0f);
+    if (packet[0] & 0x10) {
+        if (offset + 4 > size) {
+            return MIC_TCP_SEND_RELIABLE;
+        }
+        offset += 4 + 4 * ((packet[offset + 2] << 8) | packet[offset + 3]);
+    }
+    if (offset >= size) {
+        return MIC_TCP_SEND_RELIABLE;
+    }
+
+    int nal_type = packet[offset] & NAL_TYPE_MASK;
+    if (nal_type == NAL_TYPE_FU_A) {
+        /* Le type de la NAL fragmentée est dans l'en-tête FU */
+        if (offset + 1 >= size) {
+            return MIC_TCP_SEND_RELIABLE;
+        }
+        nal_type = packet[offset + 1] & NAL_TYPE_MASK;
+    } else if (nal_type == NAL_TYPE_STAP_A) {
+        /* Critique si l'une des NAL agrégées l'est, chacune précédée de sa taille sur 2 octets */
+        for (offset++; offset + 2 < size; offset += 2 + ((packet[offset] << 8) | packet[offset + 1])) {
+            if (nal_is_critical(packet[offset + 2] & NAL_TYPE_MASK)) {
+                return MIC_TCP_SEND_RELIABLE;
+            }
+        }
+        return MIC_TCP_SEND_LOSSY;
+    }
+
+    return nal_is_critical(nal_type) ? MIC_TCP_SEND_RELIABLE : MIC_TCP_SEND_LOSSY;
+}
+
 /**
  * Return (time1 - time2) when (time1 > time2), 0 otherwise
  */
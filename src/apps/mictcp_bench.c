@@ -0,0 +1,344 @@
+#include "mictcp/mictcp.h"
+#include "api/mictcp_core.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+//
+// Banc de mesure de bout en bout : un émetteur et un récepteur MIC-TCP dans
+// le même processus, sur la boucle locale. Chaque combinaison (taille de
+// message, taux de perte émulé, nombre de messages) donne une ligne CSV.
+//
+// Chaque message porte son numéro et sa date d'émission, le récepteur en
+// déduit la latence de livraison (même horloge des deux côtés).
+//
+// Par défaut les pertes sont celles de set_loss_rate. Avec une graine, un
+// modèle de dégradation reproductible est installé sur les deux sockets
+// (données et acquittements) : pertes de Bernoulli ou en rafales
+// (Gilbert-Elliott), délai, gigue, réordonnancement et duplication.
+//
+
+#define MAX_SWEEP_VALUES 16
+#define MIN_PAYLOAD_SIZE ((int) sizeof(bench_message_header))
+#define MAX_PAYLOAD_SIZE 1400
+
+#define DEFAULT_SIZES "64,512,1400"
+#define DEFAULT_LOSSES "0,2,5"
+#define DEFAULT_COUNTS "1000"
+
+typedef struct bench_message_header
+{
+    uint32_t index;        /* numéro du message */
+    uint64_t sent_usec;    /* date d'émission (µs) */
+} __attribute__((packed)) bench_message_header;
+
+typedef struct bench_run
+{
+    int listen_fd;                /* socket d'écoute du récepteur */
+    int payload_size;
+    int messages;
+    unsigned long *latencies;     /* latence de chaque message livré (µs) */
+    char *delivered_flags;        /* 1 si le message a déjà été livré */
+    int delivered;                /* messages distincts livrés */
+    unsigned long start_usec;     /* date du premier envoi */
+    unsigned long last_usec;      /* date de la dernière livraison */
+} bench_run;
+
+static mic_tcp_impairment impairment;   /* modèle commun aux mesures, sauf le taux de perte */
+static int use_impairment = 0;          /* 1 si un modèle est demandé sur la ligne de commande */
+static int loss_window = 0;             /* fenêtre de pertes du client, 0 pour la valeur par défaut */
+static unsigned long deadline_usec = 0; /* échéance de chaque message (µs), 0 pour mic_tcp_send */
+static mic_tcp_congestion congestion = CONGESTION_NEWRENO; /* contrôle de congestion du client */
+static int ack_every = 0;               /* PDUs acquittés par un même ACK du serveur, 0 pour la valeur par défaut */
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage : %s [-s tailles] [-l pertes] [-n messages] [-o fichier.csv]\n"
+            "          [-S graine] [-G p,r] [-d délai] [-j gigue] [-R réordre] [-D doublons]\n"
+            "          [-W fenêtre] [-T échéance] [-C newreno|delay] [-A paquets]\n"
+            "  -s  tailles de message en octets (défaut : " DEFAULT_SIZES ")\n"
+            "  -l  taux de perte émulés en %% (défaut : " DEFAULT_LOSSES ")\n"
+            "  -n  nombres de messages par mesure (défaut : " DEFAULT_COUNTS ")\n"
+            "  -o  fichier CSV (défaut : sortie standard)\n"
+            "  -S  graine du modèle de dégradation (implicite avec les options suivantes)\n"
+            "  -G  pertes en rafales : p = %% de passage en état mauvais, r = %% de retour,\n"
+            "      les taux de -l deviennent la perte en état mauvais\n"
+            "  -d  délai ajouté à chaque datagramme en µs\n"
+            "  -j  gigue maximale en µs\n"
+            "  -R  %% de datagrammes retenus 1 ms de plus (réordonnancement)\n"
+            "  -D  %% de datagrammes dupliqués\n"
+            "  -W  transmissions couvertes par la fenêtre de pertes du client\n"
+            "  -T  échéance de chaque message en µs (mic_tcp_send_deadline)\n"
+            "  -C  contrôle de congestion du client (défaut : newreno)\n"
+            "  -A  PDUs acquittés par un même ACK du serveur, 1 sans ACK différé\n",
+            name);
+}
+
+/**
+ * Découpe une liste "a,b,c" en entiers, renvoie le nombre de valeurs ou -1.
+ */
+static int parse_list(const char *list, int *values, int min, int max)
+{
+    char *copy = strdup(list);
+    char *save = NULL;
+    int count = 0;
+
+    for (char *token = strtok_r(copy, ",", &save); token; token = strtok_r(NULL, ",", &save)) {
+        char *end;
+        long value = strtol(token, &end, 10);
+        if (*end != '\0' || value < min || value > max || count == MAX_SWEEP_VALUES) {
+            free(copy);
+            return -1;
+        }
+        values[count++] = (int) value;
+    }
+    free(copy);
+    return count;
+}
+
+static int compare_latencies(const void *a, const void *b)
+{
+    unsigned long la = *(const unsigned long *) a;
+    unsigned long lb = *(const unsigned long *) b;
+    return (la > lb) - (la < lb);
+}
+
+static unsigned long percentile(const unsigned long *sorted, int count, double fraction)
+{
+    if (count == 0) {
+        return 0;
+    }
+    int rank = (int) (fraction * count + 0.999999);
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+/**
+ * Thread récepteur : accepte la connexion de la mesure et lit jusqu'à la fin du flux.
+ */
+static void *receiver(void *arg)
+{
+    bench_run *run = arg;
+    mic_tcp_sock_addr remote_addr;
+    char buffer[MAX_PAYLOAD_SIZE];
+
+    int fd = mic_tcp_accept(run->listen_fd, &remote_addr);
+    if (fd == -1) {
+        return NULL;
+    }
+
+    int size;
+    while ((size = mic_tcp_recv(fd, buffer, sizeof(buffer))) > 0) {
+        if (size < MIN_PAYLOAD_SIZE) {
+            continue;
+        }
+        bench_message_header header;
+        memcpy(&header, buffer, sizeof(header));
+        if (header.index >= (uint32_t) run->messages || run->delivered_flags[header.index]) {
+            continue;
+        }
+
+        unsigned long now = get_now_time_usec();
+        run->delivered_flags[header.index] = 1;
+        run->latencies[run->delivered++] = now - header.sent_usec;
+        run->last_usec = now;
+    }
+
+    mic_tcp_close(fd);
+    return NULL;
+}
+
+/**
+ * Effectue une mesure et écrit sa ligne CSV, renvoie -1 si la connexion échoue.
+ */
+static int run_bench(FILE *output, int listen_fd, int payload_size, int loss_rate, int messages)
+{
+    bench_run run;
+    memset(&run, 0, sizeof(run));
+    run.listen_fd = listen_fd;
+    run.payload_size = payload_size;
+    run.messages = messages;
+    run.latencies = calloc(messages, sizeof(unsigned long));
+    run.delivered_flags = calloc(messages, 1);
+
+    mic_tcp_sock_addr addr;
+    addr.ip_addr.addr = "127.0.0.1";
+    addr.ip_addr.addr_size = strlen(addr.ip_addr.addr) + 1;
+    addr.port = 9000;
+
+    int sockfd = mic_tcp_socket(CLIENT);
+    if (sockfd == -1) {
+        fprintf(stderr, "[BENCH] Erreur a la creation du socket MICTCP\n");
+        return -1;
+    }
+    if (use_impairment) {
+        // Une graine par sens et par mesure : chaque mesure se rejoue à l'identique
+        static unsigned long run_index = 0;
+        mic_tcp_impairment model = impairment;
+        if (model.loss_model == LOSS_GILBERT_ELLIOTT) {
+            model.ge_loss_bad = loss_rate;
+        } else {
+            model.loss_model = LOSS_BERNOULLI;
+            model.loss_rate = loss_rate;
+        }
+        model.seed = impairment.seed + 2 * run_index;
+        mic_tcp_set_impairment(sockfd, &model);
+        model.seed++;
+        mic_tcp_set_impairment(listen_fd, &model);
+        run_index++;
+    } else {
+        // mic_tcp_socket remet le taux de perte par défaut, il s'applique aux deux sens
+        set_loss_rate(loss_rate);
+    }
+
+    mic_tcp_set_congestion(sockfd, congestion);
+    if (loss_window > 0 && mic_tcp_set_loss_window(sockfd, loss_window) == -1) {
+        fprintf(stderr, "[BENCH] Fenetre de pertes invalide : %d\n", loss_window);
+        return -1;
+    }
+
+    // Le socket d'écoute ne répond aux SYN que pendant mic_tcp_accept
+    pthread_t receiver_thread;
+    pthread_create(&receiver_thread, NULL, receiver, &run);
+    if (mic_tcp_connect(sockfd, addr) == -1) {
+        // Le récepteur reste bloqué dans mic_tcp_accept, le banc s'arrête
+        fprintf(stderr, "[BENCH] Connexion impossible avec %d%% de pertes\n", loss_rate);
+        return -1;
+    }
+
+    char payload[MAX_PAYLOAD_SIZE];
+    memset(payload, 'x', sizeof(payload));
+    run.start_usec = get_now_time_usec();
+    for (int i = 0; i < messages; i++) {
+        bench_message_header header = { (uint32_t) i, get_now_time_usec() };
+        memcpy(payload, &header, sizeof(header));
+        if (deadline_usec > 0) {
+            mic_tcp_send_deadline(sockfd, payload, payload_size, deadline_usec);
+        } else {
+            mic_tcp_send(sockfd, payload, payload_size);
+        }
+    }
+
+    // Lu avant la fermeture, qui libère le socket
+    mic_tcp_stats stats;
+    mic_tcp_getstats(sockfd, &stats);
+    mic_tcp_close(sockfd);
+    pthread_join(receiver_thread, NULL);
+
+    qsort(run.latencies, run.delivered, sizeof(unsigned long), compare_latencies);
+    double elapsed_sec = run.delivered ? (run.last_usec - run.start_usec) / 1e6 : 0.0;
+    double goodput_kbps = elapsed_sec > 0 ? run.delivered * (double) payload_size * 8 / 1000 / elapsed_sec : 0.0;
+    double message_rate = elapsed_sec > 0 ? run.delivered / elapsed_sec : 0.0;
+
+    fprintf(output, "%d,%d,%d,%d,%.3f,%.1f,%.1f,%lu,%lu,%lu,%lu,%.4f\n",
+            payload_size, loss_rate, messages, run.delivered, elapsed_sec * 1000, goodput_kbps, message_rate,
+            percentile(run.latencies, run.delivered, 0.50),
+            percentile(run.latencies, run.delivered, 0.99),
+            percentile(run.latencies, run.delivered, 0.999),
+            stats.retransmissions, (double) (messages - run.delivered) / messages);
+    fflush(output);
+
+    free(run.latencies);
+    free(run.delivered_flags);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *sizes_arg = DEFAULT_SIZES;
+    const char *losses_arg = DEFAULT_LOSSES;
+    const char *counts_arg = DEFAULT_COUNTS;
+    const char *output_path = NULL;
+    int option;
+
+    memset(&impairment, 0, sizeof(impairment));
+    impairment.reorder_delay_usec = 1000;
+    while ((option = getopt(argc, argv, "s:l:n:o:S:G:d:j:R:D:W:T:C:A:h")) != -1) {
+        switch (option) {
+            case 's': sizes_arg = optarg; break;
+            case 'l': losses_arg = optarg; break;
+            case 'n': counts_arg = optarg; break;
+            case 'o': output_path = optarg; break;
+            case 'S': impairment.seed = strtoul(optarg, NULL, 10); use_impairment = 1; break;
+            case 'G':
+                if (sscanf(optarg, "%f,%f", &impairment.ge_good_to_bad, &impairment.ge_bad_to_good) != 2) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                impairment.loss_model = LOSS_GILBERT_ELLIOTT;
+                use_impairment = 1;
+                break;
+            case 'd': impairment.delay_usec = strtoul(optarg, NULL, 10); use_impairment = 1; break;
+            case 'j': impairment.jitter_usec = strtoul(optarg, NULL, 10); use_impairment = 1; break;
+            case 'R': impairment.reorder_rate = atof(optarg); use_impairment = 1; break;
+            case 'D': impairment.duplicate_rate = atof(optarg); use_impairment = 1; break;
+            case 'W': loss_window = atoi(optarg); break;
+            case 'T': deadline_usec = strtoul(optarg, NULL, 10); break;
+            case 'A': ack_every = atoi(optarg); break;
+            case 'C':
+                if (strcmp(optarg, "newreno") == 0) {
+                    congestion = CONGESTION_NEWRENO;
+                } else if (strcmp(optarg, "delay") == 0) {
+                    congestion = CONGESTION_DELAY;
+                } else {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return option == 'h' ? 0 : 1;
+        }
+    }
+
+    int sizes[MAX_SWEEP_VALUES], losses[MAX_SWEEP_VALUES], counts[MAX_SWEEP_VALUES];
+    int size_count = parse_list(sizes_arg, sizes, MIN_PAYLOAD_SIZE, MAX_PAYLOAD_SIZE);
+    int loss_count = parse_list(losses_arg, losses, 0, 100);
+    int count_count = parse_list(counts_arg, counts, 1, 10000000);
+    if (size_count <= 0 || loss_count <= 0 || count_count <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FILE *output = output_path ? fopen(output_path, "w") : stdout;
+    if (!output) {
+        perror(output_path);
+        return 1;
+    }
+
+    mic_tcp_sock_addr addr;
+    addr.ip_addr.addr = "127.0.0.1";
+    addr.ip_addr.addr_size = strlen(addr.ip_addr.addr) + 1;
+    addr.port = 9000;
+
+    int listen_fd = mic_tcp_socket(SERVER);
+    if (listen_fd == -1 || mic_tcp_bind(listen_fd, addr) == -1) {
+        fprintf(stderr, "[BENCH] Erreur a la creation du socket d'ecoute MICTCP\n");
+        return 1;
+    }
+    if (ack_every > 0 && mic_tcp_set_delayed_ack(listen_fd, ack_every) == -1) {
+        fprintf(stderr, "[BENCH] Nombre de PDUs par ACK invalide : %d\n", ack_every);
+        return 1;
+    }
+
+    fprintf(output, "payload_size,loss_rate,messages,delivered,elapsed_ms,goodput_kbps,messages_per_sec,"
+                    "latency_p50_us,latency_p99_us,latency_p999_us,retransmissions,delivered_loss_ratio\n");
+    for (int s = 0; s < size_count; s++) {
+        for (int l = 0; l < loss_count; l++) {
+            for (int c = 0; c < count_count; c++) {
+                if (run_bench(output, listen_fd, sizes[s], losses[l], counts[c]) == -1) {
+                    return 1;
+                }
+            }
+        }
+    }
+    print_batch_stats();
+
+    if (output != stdout) {
+        fclose(output);
+    }
+    return 0;
+}
@@ -35,27 +35,36 @@ int main(int argc, char *argv[])
         printf("[TSOCK] Bind du socket MICTCP: OK\n");
     }
 
-    if (mic_tcp_accept(sockfd, &remote_addr) == -1)
-    {
-        printf("[TSOCK] Erreur lors de l'accept sur le socket MICTCP!\n");
-        return 1;
-    }
-    else
-    {
-        printf("[TSOCK] Accept sur le socket MICTCP: OK\n");
-    }
+    printf("[TSOCK] Appuyez sur CTRL+C pour quitter ...\n");
 
+    while(1) {
+        int connfd;
+        if ((connfd = mic_tcp_accept(sockfd, &remote_addr)) == -1)
+        {
+            printf("[TSOCK] Erreur lors de l'accept sur le socket MICTCP!\n");
+            return 1;
+        }
+        else
+        {
+            printf("[TSOCK] Accept sur le socket MICTCP: OK\n");
+        }
 
-    memset(chaine, 0, MAX_SIZE);
+        memset(chaine, 0, MAX_SIZE);
 
-    printf("[TSOCK] Appuyez sur CTRL+C pour quitter ...\n");
+        while(1) {
+            int rcv_size = 0;
+            printf("[TSOCK] Attente d'une donnee, appel de mic_recv ...\n");
+            rcv_size = mic_tcp_recv(connfd, chaine, MAX_SIZE);
+            if (rcv_size <= 0) {
+                printf("[TSOCK] Fin de la connexion\n");
+                break;
+            }
+            printf("[TSOCK] Reception d'un message de taille : %d\n", rcv_size);
+            printf("[TSOCK] Message Recu : %s\n", chaine);
+        }
 
-    while(1) {
-        int rcv_size = 0;
-        printf("[TSOCK] Attente d'une donnee, appel de mic_recv ...\n");
-        rcv_size = mic_tcp_recv(sockfd, chaine, MAX_SIZE);
-        printf("[TSOCK] Reception d'un message de taille : %d\n", rcv_size);
-        printf("[TSOCK] Message Recu : %s\n", chaine);
+        mic_tcp_close(connfd);
+        print_batch_stats();
     }
     return 0;
 }
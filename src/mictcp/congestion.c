@@ -0,0 +1,172 @@
+#include "mictcp/congestion.h"
+#include "mictcp/mictcp_config.h"
+#include "mictcp/mictcp_log.h"
+#include <stdio.h>
+
+/*
+ * The congestion window bounds the PDUs in flight, on top of the send window.
+ * The generic part below detects the congestion events, the algorithms only
+ * decide how cwnd and ssthresh react to them.
+ *
+ * Loss detection: CONGESTION_DUPACK_THRESHOLD ACKs in a row that do not move
+ * send_base mean a PDU was lost while the following ones arrived. A NACK from
+ * the receiver says so at once, without waiting for the threshold. The window
+ * is reduced once per window of data: until send_base passes the recovery
+ * point (the PDUs in flight at the reduction), further losses are part of the
+ * same congestion event.
+ *
+ * NewReno (RFC 5681, RFC 6582): slow start doubles cwnd every RTT up to
+ * ssthresh, then congestion avoidance adds one PDU per RTT. A loss halves the
+ * window, a timeout restarts from one PDU.
+ *
+ * Delay (TCP Vegas): the smallest RTT measured is the propagation delay, so
+ * cwnd * (1 - base_rtt / rtt) is the number of PDUs queued along the path.
+ * Once per RTT, cwnd grows while fewer than CONGESTION_DELAY_ALPHA PDUs are
+ * queued and shrinks past CONGESTION_DELAY_BETA. The queue, and so the
+ * latency, stays short, which suits media. Losses and timeouts only halve
+ * the window instead of restarting from one PDU.
+ */
+
+static unsigned int flight_size(mic_tcp_sock *sock) {
+    return sock->current_seq_num - sock->send_base;
+}
+
+static unsigned int half_flight(mic_tcp_sock *sock) {
+    unsigned int half = flight_size(sock) / 2;
+    return half > 2 ? half : 2;
+}
+
+static void grow(mic_tcp_sock *sock, unsigned int increment) {
+    sock->cwnd += increment;
+    // A larger window could never be used, the send window stops first
+    if (sock->cwnd > SEND_WINDOW_SIZE) {
+        sock->cwnd = SEND_WINDOW_SIZE;
+    }
+}
+
+static void newreno_on_ack(mic_tcp_sock *sock, unsigned int acked, unsigned long rtt_sample) {
+    (void) rtt_sample;
+    if (sock->cwnd < sock->ssthresh) {
+        grow(sock, acked);
+        return;
+    }
+    sock->cwnd_credit += acked;
+    if (sock->cwnd_credit >= sock->cwnd) {
+        sock->cwnd_credit -= sock->cwnd;
+        grow(sock, 1);
+    }
+}
+
+static void newreno_on_loss(mic_tcp_sock *sock) {
+    sock->ssthresh = half_flight(sock);
+    sock->cwnd = sock->ssthresh;
+}
+
+static void newreno_on_timeout(mic_tcp_sock *sock) {
+    sock->ssthresh = half_flight(sock);
+    sock->cwnd = 1;
+}
+
+static void delay_on_ack(mic_tcp_sock *sock, unsigned int acked, unsigned long rtt_sample) {
+    if (rtt_sample) {
+        sock->latest_rtt = rtt_sample;
+        if (sock->base_rtt == 0 || rtt_sample < sock->base_rtt) {
+            sock->base_rtt = rtt_sample;
+        }
+    }
+
+    // Decide once per window of acknowledged PDUs, about once per RTT
+    sock->cwnd_credit += acked;
+    if (sock->cwnd_credit < sock->cwnd || sock->latest_rtt == 0) {
+        return;
+    }
+    sock->cwnd_credit = 0;
+
+    unsigned long queued = sock->cwnd * (sock->latest_rtt - sock->base_rtt) / sock->latest_rtt;
+    if (queued < CONGESTION_DELAY_ALPHA) {
+        grow(sock, sock->cwnd < sock->ssthresh ? sock->cwnd : 1);
+    } else if (sock->cwnd < sock->ssthresh) {
+        // The queue builds up: slow start is over
+        sock->ssthresh = sock->cwnd;
+    } else if (queued > CONGESTION_DELAY_BETA && sock->cwnd > 2) {
+        sock->cwnd--;
+    }
+}
+
+static void delay_on_loss(mic_tcp_sock *sock) {
+    sock->ssthresh = half_flight(sock);
+    sock->cwnd = sock->ssthresh;
+}
+
+static const congestion_ops newreno = {
+    "NewReno", newreno_on_ack, newreno_on_loss, newreno_on_timeout
+};
+
+static const congestion_ops delay_based = {
+    "delay", delay_on_ack, delay_on_loss, delay_on_loss
+};
+
+void congestion_init(mic_tcp_sock *sock, mic_tcp_congestion algorithm) {
+    sock->congestion = algorithm == CONGESTION_DELAY ? &delay_based : &newreno;
+    sock->cwnd = CONGESTION_INITIAL_WINDOW;
+    sock->ssthresh = SEND_WINDOW_SIZE;
+    sock->cwnd_credit = 0;
+    sock->duplicate_acks = 0;
+    sock->in_recovery = 0;
+    sock->base_rtt = 0;
+    sock->latest_rtt = 0;
+}
+
+unsigned int congestion_window(mic_tcp_sock *sock) {
+    return sock->cwnd < SEND_WINDOW_SIZE ? sock->cwnd : SEND_WINDOW_SIZE;
+}
+
+void congestion_on_ack(mic_tcp_sock *sock, unsigned int acked, unsigned long rtt_sample) {
+    sock->duplicate_acks = 0;
+    // The window only grows again once the PDUs in flight at the reduction are through
+    if (sock->in_recovery) {
+        if ((int) (sock->send_base - sock->recovery_point) < 0) {
+            return;
+        }
+        sock->in_recovery = 0;
+    }
+    sock->congestion->on_ack(sock, acked, rtt_sample);
+}
+
+/**
+ * @brief Reduces the window once per congestion event
+ * @return 1 if a new congestion event started, 0 if already in recovery
+ */
+static int enter_recovery(mic_tcp_sock *sock) {
+    if (sock->in_recovery) {
+        return 0;
+    }
+    sock->congestion->on_loss(sock);
+    sock->in_recovery = 1;
+    sock->recovery_point = sock->current_seq_num;
+    sock->cwnd_credit = 0;
+    LOG_DEBUG(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "%s: loss detected, cwnd %u, ssthresh %u"
+              ANSI_COLOR_RESET "\n", sock->congestion->name, sock->cwnd, sock->ssthresh);
+    return 1;
+}
+
+int congestion_on_duplicate_ack(mic_tcp_sock *sock) {
+    if (++sock->duplicate_acks != CONGESTION_DUPACK_THRESHOLD) {
+        return 0;
+    }
+    return enter_recovery(sock);
+}
+
+int congestion_on_nack(mic_tcp_sock *sock) {
+    return enter_recovery(sock);
+}
+
+void congestion_on_timeout(mic_tcp_sock *sock) {
+    // Slow start restarts right away, the retransmissions are clocked by their ACKs
+    sock->congestion->on_timeout(sock);
+    sock->in_recovery = 0;
+    sock->duplicate_acks = 0;
+    sock->cwnd_credit = 0;
+    LOG_DEBUG(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "%s: timeout, cwnd %u, ssthresh %u"
+              ANSI_COLOR_RESET "\n", sock->congestion->name, sock->cwnd, sock->ssthresh);
+}
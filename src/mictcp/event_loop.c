@@ -0,0 +1,229 @@
+#include "mictcp/event_loop.h"
+#include "mictcp/send_window.h"
+#include "mictcp/mictcp_config.h"
+#include "mictcp/mictcp_log.h"
+#include "mictcp/mictcp_sock_lookup.h"
+#include "api/mictcp_core.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/epoll.h>
+
+/*
+ * EVENT_LOOP_THREADS threads multiplex every system socket through epoll,
+ * instead of one network thread per socket. A system socket is bound to
+ * loop sys_socket % EVENT_LOOP_THREADS for its whole life, which keeps the
+ * single-producer guarantee of the receive queues.
+ *
+ * Each loop keeps its registrations in an array indexed by sys_socket and
+ * protected by the loop lock, held while events are processed. epoll only
+ * carries the sys_socket, so an event for a socket unregistered in the
+ * meantime finds no registration and is dropped.
+ *
+ * Retransmission timers of the client sockets, and the connection timers of
+ * the listening sockets, are checked by the loop itself: epoll_wait returns
+ * at the latest when the earliest timer expires.
+ */
+
+typedef struct event_registration
+{
+    int fd;                 /* socket MIC-TCP, -1 si l'emplacement est libre */
+    start_mode mode;        /* SERVER : process_server_PDU, CLIENT : process_client_PDU et temporisateurs */
+} event_registration;
+
+typedef struct event_loop
+{
+    int epoll_fd;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    event_registration *registrations; /* indexées par sys_socket */
+    int capacity;
+    unsigned long next_timer_check;    /* date du prochain passage sur les temporisateurs (µs) */
+} event_loop;
+
+static event_loop loops[EVENT_LOOP_THREADS > 0 ? EVENT_LOOP_THREADS : 1];
+static pthread_once_t loops_once = PTHREAD_ONCE_INIT;
+static int loops_started = 0;
+
+static event_loop *get_loop(int sys_socket) {
+    return &loops[sys_socket % (EVENT_LOOP_THREADS > 0 ? EVENT_LOOP_THREADS : 1)];
+}
+
+/**
+ * @brief Receives one batch on a readable system socket and dispatches it, loop->lock must be held
+ */
+static void handle_readable(int sys_socket, event_registration *registration,
+                            mic_tcp_pdu *pdus, struct sockaddr_in *remote_addrs, int payload_size) {
+    for (int i = 0; i < API_BATCH_Size; i++) {
+        pdus[i].payload.size = payload_size;
+    }
+    int count = IP_try_recv_batch(sys_socket, pdus, remote_addrs, API_BATCH_Size);
+
+    for (int i = 0; i < count; i++) {
+        if (registration->mode == SERVER) {
+            process_server_PDU(sys_socket, pdus[i], &remote_addrs[i]);
+        } else {
+            process_client_PDU(sys_socket, pdus[i], &remote_addrs[i]);
+        }
+    }
+}
+
+/**
+ * @brief Fires the expired retransmission timers of the loop, loop->lock must be held
+ * @return Delay before the next timer expires, in milliseconds
+ */
+static unsigned long handle_timers(event_loop *loop) {
+    unsigned long next_timeout = TIMEOUT;
+
+    for (int sys_socket = 0; sys_socket < loop->capacity; sys_socket++) {
+        event_registration *registration = &loop->registrations[sys_socket];
+        if (registration->fd == -1) {
+            continue;
+        }
+        if (registration->mode == SERVER) {
+            // Handshakes of the connections accepted on this listening socket
+            unsigned long timeout = server_check_timeouts(sys_socket);
+            if (timeout && timeout < next_timeout) {
+                next_timeout = timeout;
+            }
+            continue;
+        }
+        mic_tcp_sock *sock = get_socket_by_fd(registration->fd);
+        if (!sock || !sock->send_window) {
+            continue;
+        }
+        send_window_check_timeouts(sock);
+        unsigned long timeout = send_window_next_timeout(sock);
+        if (timeout < next_timeout) {
+            next_timeout = timeout;
+        }
+    }
+    return next_timeout;
+}
+
+static void *event_loop_run(void *arg) {
+    event_loop *loop = arg;
+    struct epoll_event events[API_BATCH_Size];
+    mic_tcp_pdu pdus[API_BATCH_Size];
+    struct sockaddr_in remote_addrs[API_BATCH_Size];
+    const int payload_size = API_MTU - API_HD_Size;
+
+    for (int i = 0; i < API_BATCH_Size; i++) {
+        pdus[i].payload.data = malloc(payload_size);
+    }
+
+    LOG_INFO(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_CYAN "Event loop thread started" ANSI_COLOR_RESET "\n");
+
+    unsigned long wait_ms = TIMEOUT;
+    while (1) {
+        int ready = epoll_wait(loop->epoll_fd, events, API_BATCH_Size, (int) wait_ms);
+        if (ready == -1 && errno != EINTR) {
+            LOG_ERROR(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_RED "epoll_wait failed, event loop stopped" ANSI_COLOR_RESET "\n");
+            break;
+        }
+
+        pthread_mutex_lock(&loop->lock);
+        // Every PDU sent while handling this round leaves in a single batch
+        IP_send_batch_begin();
+        for (int i = 0; i < ready; i++) {
+            int sys_socket = events[i].data.fd;
+            if (sys_socket < loop->capacity && loop->registrations[sys_socket].fd != -1) {
+                handle_readable(sys_socket, &loop->registrations[sys_socket], pdus, remote_addrs, payload_size);
+            }
+        }
+        // The ACKs delayed by the server sockets wait no longer than the round
+        flush_delayed_acks();
+
+        unsigned long now = get_now_time_usec();
+        if (now >= loop->next_timer_check) {
+            loop->next_timer_check = now + handle_timers(loop) * 1000;
+        }
+        IP_send_batch_flush();
+
+        now = get_now_time_usec();
+        wait_ms = loop->next_timer_check > now ? (loop->next_timer_check - now + 999) / 1000 : 0;
+        pthread_mutex_unlock(&loop->lock);
+    }
+
+    for (int i = 0; i < API_BATCH_Size; i++) {
+        free(pdus[i].payload.data);
+    }
+    return NULL;
+}
+
+static void start_loops(void) {
+    for (int i = 0; i < EVENT_LOOP_THREADS; i++) {
+        event_loop *loop = &loops[i];
+        loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        loop->registrations = NULL;
+        loop->capacity = 0;
+        loop->next_timer_check = 0;
+        pthread_mutex_init(&loop->lock, NULL);
+        if (loop->epoll_fd == -1 || pthread_create(&loop->thread, NULL, event_loop_run, loop) != 0) {
+            LOG_ERROR(LOG_PREFIX ANSI_COLOR_RED "Failed to start event loop %d" ANSI_COLOR_RESET "\n", i);
+            return;
+        }
+        pthread_detach(loop->thread);
+    }
+    loops_started = 1;
+}
+
+int event_loop_register(mic_tcp_sock *sock, start_mode mode) {
+    if (EVENT_LOOP_THREADS <= 0) {
+        return -1;
+    }
+    pthread_once(&loops_once, start_loops);
+    if (!loops_started) {
+        return -1;
+    }
+
+    event_loop *loop = get_loop(sock->sys_socket);
+    pthread_mutex_lock(&loop->lock);
+    if (sock->sys_socket >= loop->capacity) {
+        int capacity = loop->capacity ? loop->capacity : SOCKET_CHUNK_SIZE;
+        while (capacity <= sock->sys_socket) {
+            capacity *= 2;
+        }
+        event_registration *registrations = realloc(loop->registrations, capacity * sizeof(event_registration));
+        if (!registrations) {
+            pthread_mutex_unlock(&loop->lock);
+            return -1;
+        }
+        for (int i = loop->capacity; i < capacity; i++) {
+            registrations[i].fd = -1;
+        }
+        loop->registrations = registrations;
+        loop->capacity = capacity;
+    }
+    loop->registrations[sock->sys_socket].fd = sock->fd;
+    loop->registrations[sock->sys_socket].mode = mode;
+    // Check the timers of the new socket without waiting for the current deadline
+    loop->next_timer_check = 0;
+    pthread_mutex_unlock(&loop->lock);
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = sock->sys_socket;
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, sock->sys_socket, &event) == -1) {
+        event_loop_unregister(sock);
+        return -1;
+    }
+
+    LOG_INFO(LOG_PREFIX ANSI_COLOR_GREEN "Sys FD %d registered in the event loop" ANSI_COLOR_RESET "\n", sock->sys_socket);
+    return 0;
+}
+
+void event_loop_unregister(mic_tcp_sock *sock) {
+    if (!loops_started) {
+        return;
+    }
+    event_loop *loop = get_loop(sock->sys_socket);
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, sock->sys_socket, NULL);
+
+    // Waits for the round in progress, the loop cannot reach the socket afterwards
+    pthread_mutex_lock(&loop->lock);
+    if (sock->sys_socket < loop->capacity) {
+        loop->registrations[sock->sys_socket].fd = -1;
+    }
+    pthread_mutex_unlock(&loop->lock);
+}
@@ -1,88 +1,74 @@
 #include "mictcp/mictcp_pdu.h"
 #include "mictcp/sliding_window.h"
+#include "mictcp/send_window.h"
+#include "mictcp/reorder_buffer.h"
+#include "mictcp/rtt_estimator.h"
 #include "mictcp/mictcp.h"
 #include "mictcp/mictcp_config.h"
+#include "mictcp/mictcp_log.h"
+#include "mictcp/mictcp_stats.h"
 #include "mictcp/mictcp_sock_lookup.h"
+#include "mictcp/event_loop.h"
 #include "api/mictcp_core.h"
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
 
 /**
- * @brief Sends application data with reliability checks
+ * @brief Queues application data in the send window, retransmissions and
+ *        loss tolerance are handled by the network thread
  * @param mic_sock Socket descriptor
  * @param msg Data to send
  * @param msg_size Size of data
- * @return Number of bytes sent, -1 on error
+ * @param deadline_us Lifetime of the message in microseconds, 0 for none
+ * @param flags MIC_TCP_SEND_* options
+ * @return Number of bytes sent, 0 if the deadline passed before sending, -1 on error
  */
-int mic_tcp_send(int mic_sock, char *msg, int msg_size) {
-    printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_MAGENTA "Sending data (Size: %d bytes)..." ANSI_COLOR_RESET "\n", msg_size);
+static int send_common(int mic_sock, char *msg, int msg_size, unsigned long deadline_us, int flags) {
+    LOG_DEBUG(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_MAGENTA "Sending %s data (Size: %d bytes, Deadline: %lu us)..." ANSI_COLOR_RESET "\n",
+              flags & MIC_TCP_SEND_RELIABLE ? "reliable" : "lossy", msg_size, deadline_us);
     
     mic_tcp_sock *sock = get_socket_by_fd(mic_sock);
-    if (!sock || sock->state != ESTABLISHED) {
-        printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Error: Invalid or non-established socket FD %d" ANSI_COLOR_RESET "\n", mic_sock);
+    if (!sock || sock->state != ESTABLISHED || !sock->send_window) {
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Error: Invalid or non-established socket FD %d" ANSI_COLOR_RESET "\n", mic_sock);
         return -1;
     }
     
-    int result;
-    char msg_to_send = 1;
-    
-    while (msg_to_send) {
-        printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_YELLOW "Sending packet (Seq: %d)..." ANSI_COLOR_RESET "\n",
-               sock->current_seq_num);
-        mic_tcp_pdu packet = create_nopayload_pdu(0, 0, 0, sock->current_seq_num, 0,
-                                             sock->local_addr.port,
-                                             sock->remote_addr.port);
-        mic_tcp_payload payload = { .data = msg, .size = msg_size };
-        packet.payload = payload;
-        unsigned int expected_ack_num = sock->current_seq_num + 1;
-
-        result = IP_send(sock->sys_socket, packet, sock->remote_addr.ip_addr);
-        if (result == -1) {
-            printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Failed to send packet" ANSI_COLOR_RESET "\n");
-            return -1;
-        }
-        
-        printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_YELLOW "Waiting for ACK..." ANSI_COLOR_RESET "\n");
-        pthread_mutex_lock(&sock->lock);
-        
-        struct timespec timeout;
-        clock_gettime(CLOCK_REALTIME, &timeout);
-        timeout.tv_sec += TIMEOUT / 1000;
-        timeout.tv_nsec += (TIMEOUT % 1000) * 1e6;
-        if (timeout.tv_nsec > 1e9) {
-            timeout.tv_nsec %= (long) 1e9;
-        }
-        
-        result = pthread_cond_timedwait(&sock->cond, &sock->lock, &timeout);
-        pthread_mutex_unlock(&sock->lock);
-        if (result == ETIMEDOUT) {
-            printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_YELLOW "Timeout waiting for ACK..." ANSI_COLOR_RESET "\n");
-            if (verify_acceptable_loss(sock)) {
-                printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "Loss acceptable, continuing..." ANSI_COLOR_RESET "\n");
-                update_sliding_window(sock, 0);
-                return 0;
-            }
-            continue;
-        } else if (result != 0) {
-            printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Error waiting for ACK: %d" ANSI_COLOR_RESET "\n", result);
-            return -1;
-        }
-        
-        // Check if a valid ACK was received (updated by process_client_PDU)
-        if (sock->current_seq_num != expected_ack_num) {
-            printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_YELLOW "Invalid ACK number (%d != %d), retrying..." 
-                   ANSI_COLOR_RESET "\n", sock->current_seq_num, expected_ack_num);
-            continue;
-        }
-        
-        printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "ACK received successfully (Seq: %d)" 
-               ANSI_COLOR_RESET "\n", sock->current_seq_num - 1);
-        msg_to_send = 0;
-        update_sliding_window(sock, 1);
+    unsigned long deadline = deadline_us ? get_now_time_usec() + deadline_us : 0;
+    int result = send_window_push(sock, msg, msg_size, deadline, flags);
+    if (result == -1) {
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Failed to queue packet" ANSI_COLOR_RESET "\n");
     }
     
-    return msg_size;
+    return result;
+}
+
+/**
+ * @brief Sends data with the lossy policy of the socket
+ */
+int mic_tcp_send(int mic_sock, char *msg, int msg_size) {
+    return send_common(mic_sock, msg, msg_size, 0, MIC_TCP_SEND_LOSSY);
+}
+
+/**
+ * @brief Sends data that is given up instead of retransmitted past a deadline
+ */
+int mic_tcp_send_deadline(int mic_sock, char *msg, int msg_size, unsigned long deadline_us) {
+    return send_common(mic_sock, msg, msg_size, deadline_us, MIC_TCP_SEND_LOSSY);
+}
+
+/**
+ * @brief Sends data with a per-message reliability class
+ */
+int mic_tcp_send_flags(int mic_sock, char *msg, int msg_size, int flags) {
+    return send_common(mic_sock, msg, msg_size, 0, flags);
+}
+
+/**
+ * @brief Sends data with both a deadline and a reliability class
+ */
+int mic_tcp_send_deadline_flags(int mic_sock, char *msg, int msg_size, unsigned long deadline_us, int flags) {
+    return send_common(mic_sock, msg, msg_size, deadline_us, flags);
 }
 
 /**
@@ -93,19 +79,25 @@ int mic_tcp_send(int mic_sock, char *msg, int msg_size) {
  * @return Number of bytes received, -1 on error
  */
 int mic_tcp_recv(int socket, char *msg, int max_msg_size) {
-    printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_MAGENTA "Receiving data..." ANSI_COLOR_RESET "\n");
+    LOG_DEBUG(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_MAGENTA "Receiving data..." ANSI_COLOR_RESET "\n");
     
     mic_tcp_sock *sock = get_socket_by_fd(socket);
     if (!sock) {
-        printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Invalid socket FD %d" ANSI_COLOR_RESET "\n", socket);
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Invalid socket FD %d" ANSI_COLOR_RESET "\n", socket);
+        return -1;
+    }
+    
+    if (!sock->recv_buffer.data) {
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Socket FD %d has no receive queue" ANSI_COLOR_RESET "\n", socket);
         return -1;
     }
     
+    // Only this connection's queue is read, other connections never wake us up
     mic_tcp_payload payload_to_receive = { .data = msg, .size = max_msg_size };
-    int result = app_buffer_get(payload_to_receive);
+    int result = app_buffer_get(&sock->recv_buffer, payload_to_receive);
     
-    printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "Received %d bytes from buffer" ANSI_COLOR_RESET "\n", 
-           result);
+    LOG_DEBUG(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "Received %d bytes from buffer" ANSI_COLOR_RESET "\n", 
+              result);
     return result;
 }
 
@@ -115,17 +107,45 @@ int mic_tcp_recv(int socket, char *msg, int max_msg_size) {
  * @return 0 on success, -1 on failure
  */
 int mic_tcp_close(int socket) {
-    printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_MAGENTA "Closing socket..." ANSI_COLOR_RESET "\n");
+    LOG_INFO(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_MAGENTA "Closing socket..." ANSI_COLOR_RESET "\n");
     
     mic_tcp_sock *sock = get_socket_by_fd(socket);
     if (!sock) {
-        printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Invalid socket FD %d" ANSI_COLOR_RESET "\n", socket);
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Invalid socket FD %d" ANSI_COLOR_RESET "\n", socket);
         return -1;
     }
     
+    // Only an established connection runs the FIN exchange. A listening socket, a
+    // connection the peer closed, or a failed handshake is simply released
+    if (sock->state != ESTABLISHED && sock->state != MEASURING_RELIABILITY) {
+        // A connection closed by its peer still answers its repeated FINs, the network thread releases it
+        if (server_linger_close(sock)) {
+            LOG_INFO(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "Socket closed, released after the final ACK of the peer"
+                     ANSI_COLOR_RESET "\n");
+            return 0;
+        }
+        socket_unhash(sock);
+        socket_set_state(sock, CLOSED);
+        LOG_INFO(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "Socket closed successfully" ANSI_COLOR_RESET "\n");
+        if (!sock->accept_backlog) {
+            stats_log(sock);
+        }
+        socket_cleanup(sock);
+        return 0;
+    }
+    
+    if (send_window_flush(sock) == -1) {
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Peer stopped acknowledging, in-flight data dropped" 
+                  ANSI_COLOR_RESET "\n");
+    }
+    
     socket_set_state(sock, CLOSING);
     
-    mic_tcp_pdu close_req = create_nopayload_pdu(0, 0, 1, 0, 0,
+    // The FIN carries send_base like data PDUs, the peer skips what was given up before the end of stream
+    pthread_mutex_lock(&sock->lock);
+    unsigned int send_base = sock->send_window ? sock->send_base : 0;
+    pthread_mutex_unlock(&sock->lock);
+    mic_tcp_pdu close_req = create_nopayload_pdu(0, 0, 1, 0, send_base,
                                                   sock->local_addr.port,
                                                   sock->remote_addr.port);
     
@@ -133,64 +153,99 @@ int mic_tcp_close(int socket) {
     int fin_ack_received = 0;
     
     while (!fin_ack_received && attempts < MAX_ATTEMPTS) {
-        printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_YELLOW "Sending FIN (Attempt %d)..." ANSI_COLOR_RESET "\n",
-               attempts + 1);
-        int result = IP_send(sock->sys_socket, close_req, sock->remote_addr.ip_addr);
+        LOG_DEBUG(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_YELLOW "Sending FIN (Attempt %d)..." ANSI_COLOR_RESET "\n",
+                  attempts + 1);
+        int result = IP_send(sock->sys_socket, close_req, &sock->peer_addr);
         if (result == -1) {
-            printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Failed to send FIN" ANSI_COLOR_RESET "\n");
+            LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Failed to send FIN" ANSI_COLOR_RESET "\n");
             attempts++;
             continue;
         }
-        printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "FIN sent successfully" ANSI_COLOR_RESET "\n");
+        LOG_DEBUG(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "FIN sent successfully" ANSI_COLOR_RESET "\n");
         
         struct timespec timeout;
-        clock_gettime(CLOCK_REALTIME, &timeout);
-        timeout.tv_sec += 5 * TIMEOUT / 1000;
-        timeout.tv_nsec += (TIMEOUT % 1000) * 1e6;
-        if (timeout.tv_nsec > 1e9) {
-            timeout.tv_nsec %= (long) 1e9;
-        }
+        rtt_deadline(sock, &timeout, 1);
 
+        // The network thread moves the socket to CLOSED once the FIN+ACK is received
         pthread_mutex_lock(&sock->lock);
-        result = pthread_cond_timedwait(&sock->cond, &sock->lock, &timeout);
+        result = 0;
+        while (sock->state == CLOSING && result == 0) {
+            result = pthread_cond_timedwait(&sock->cond, &sock->lock, &timeout);
+        }
+        fin_ack_received = sock->state == CLOSED;
         pthread_mutex_unlock(&sock->lock);
-        if (result == ETIMEDOUT) {
-            printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_YELLOW "Timeout waiting for FIN+ACK, retrying..." 
-                   ANSI_COLOR_RESET "\n");
+        if (fin_ack_received) {
+            break;
+        } else if (result == ETIMEDOUT) {
+            LOG_WARN(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_YELLOW "Timeout waiting for FIN+ACK, retrying..." 
+                     ANSI_COLOR_RESET "\n");
+            rtt_backoff(sock);
             attempts++;
-        } else if (result != 0) {
-            printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Error waiting for FIN+ACK: %d" ANSI_COLOR_RESET "\n", result);
-            return -1;
         } else {
-            fin_ack_received = 1;
+            LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Error waiting for FIN+ACK: %d" ANSI_COLOR_RESET "\n", result);
+            return -1;
         }
     }
     
     if (!fin_ack_received) {
-        printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Failed to receive FIN+ACK after %d attempts" 
-               ANSI_COLOR_RESET "\n", MAX_ATTEMPTS);
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Failed to receive FIN+ACK after %d attempts" 
+                  ANSI_COLOR_RESET "\n", MAX_ATTEMPTS);
     } else {
-        printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "FIN+ACK received successfully" ANSI_COLOR_RESET "\n");
+        LOG_DEBUG(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "FIN+ACK received successfully" ANSI_COLOR_RESET "\n");
     }
     
     mic_tcp_pdu ack_response = create_nopayload_pdu(0, 1, 0, 0, 0,
                                                    sock->local_addr.port,
                                                    sock->remote_addr.port);
-    IP_send(sock->sys_socket, ack_response, sock->remote_addr.ip_addr);
+    IP_send(sock->sys_socket, ack_response, &sock->peer_addr);
     
     socket_set_state(sock, CLOSED);
     
-    printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "Socket closed successfully" ANSI_COLOR_RESET "\n");
+    LOG_INFO(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "Socket closed successfully" ANSI_COLOR_RESET "\n");
+    // Without the FIN+ACK of its peer, an accepted connection is still reachable from the network thread
+    if (server_linger_close(sock)) {
+        return 0;
+    }
+    stats_log(sock);
     
+    socket_unhash(sock);
     socket_cleanup(sock);
     
     return 0;
 }
 
+/**
+ * @brief Prints the average and largest batch sizes achieved by the core I/O
+ */
+void print_batch_stats(void) {
+    ip_batch_stats stats;
+    IP_get_batch_stats(&stats);
+    LOG_INFO(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_CYAN "RX batches: %lu (avg %.2f, max %lu), TX batches: %lu (avg %.2f, max %lu)"
+             ANSI_COLOR_RESET "\n",
+             stats.rx_calls, stats.rx_calls ? (double) stats.rx_datagrams / stats.rx_calls : 0.0, stats.rx_max_batch,
+             stats.tx_calls, stats.tx_calls ? (double) stats.tx_datagrams / stats.tx_calls : 0.0, stats.tx_max_batch);
+}
+
 void socket_cleanup(mic_tcp_sock* sock) {
-    pthread_join(sock->listen_thread, NULL);
-    close(sock->sys_socket);
+    if (sock->listen_thread) {
+        pthread_join(sock->listen_thread, NULL);
+    }
+    // Accepted connections share the system socket of their listening socket
+    if (!sock->shares_sys_socket) {
+#if EVENT_LOOP_THREADS > 0
+        event_loop_unregister(sock);
+#endif
+        IP_clear_impairment(sock->sys_socket);
+        close(sock->sys_socket);
+    }
     pthread_cond_signal(&sock->cond);
     pthread_cond_destroy(&sock->cond);
     pthread_mutex_destroy(&sock->lock);
+    send_window_free(sock);
+    loss_window_free(sock);
+    app_buffer_free(&sock->recv_buffer);
+    reorder_buffer_free(sock);
+    free(sock->accept_backlog);
+    sock->accept_backlog = NULL;
+    release_socket(sock);
 }
\ No newline at end of file
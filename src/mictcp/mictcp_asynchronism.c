@@ -1,177 +1,582 @@
 #include "mictcp/mictcp_pdu.h"
 #include "mictcp/sliding_window.h"
+#include "mictcp/send_window.h"
+#include "mictcp/reorder_buffer.h"
+#include "mictcp/rtt_estimator.h"
 #include "mictcp/mictcp.h"
 #include "mictcp/mictcp_config.h"
+#include "mictcp/mictcp_log.h"
+#include "mictcp/mictcp_stats.h"
+#include "mictcp/probe.h"
 #include "mictcp/mictcp_sock_lookup.h"
 #include "api/mictcp_core.h"
 #include <stdio.h>
 #include <string.h>
 
-void handle_awaiting_closing_state(mic_tcp_pdu* pdu, mic_tcp_sock* sock, int sys_socket, mic_tcp_ip_addr local_addr, mic_tcp_ip_addr remote_addr) {
+/*
+ * Delayed ACKs: an in-order data PDU is acknowledged together with the next
+ * ones, every ack_every PDUs, and at the latest once the receive batch it came
+ * in is processed (flush_delayed_acks). The batch ends when the system socket
+ * has nothing more to read, so holding the ACK any longer would only slow the
+ * sender down. Out-of-order PDUs, duplicates, PDUs filling a gap and the FIN
+ * are acknowledged at once (RFC 5681), the sender needs them to detect losses.
+ *
+ * The connections waiting for their ACK are listed per network thread: the
+ * PDUs of a system socket are always processed by the same thread.
+ */
+static __thread int delayed_acks[API_BATCH_Size];
+static __thread int delayed_ack_count = 0;
+
+/**
+ * @brief Sends the cumulative ACK of a connection, carrying its window and SACK blocks
+ * @param sock Connection socket
+ * @param echo Timestamp of the PDU acknowledged last
+ * @param trigger Sequence number of the PDU that triggered the ACK
+ * @param nack 1 if the PDU revealed a new gap
+ */
+static void send_data_acknowledgement(mic_tcp_sock *sock, unsigned int echo, unsigned int trigger, char nack) {
+    LOG_DEBUG(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Sending ACK (Ack: %d)..." ANSI_COLOR_RESET "\n",
+              sock->current_seq_num);
+    sock->ack_pending = 0;
+    mic_tcp_pdu acknowledgment = create_nopayload_pdu(0, 1, 0, 0,
+                                                    sock->current_seq_num,
+                                                    sock->local_addr.port,
+                                                    sock->remote_addr.port);
+    acknowledgment.header.timestamp_echo = echo;
+    acknowledgment.header.window = app_buffer_space(&sock->recv_buffer);
+    acknowledgment.header.nack = nack;
+    reorder_buffer_fill_sack(sock, &acknowledgment, trigger);
+    STATS_ADD(sock, acks_sent, 1);
+    int result = IP_send(sock->sys_socket, acknowledgment, &sock->peer_addr);
+    if (result == -1) {
+        LOG_ERROR(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_RED "Failed to send ACK for Seq %d" 
+                  ANSI_COLOR_RESET "\n", sock->current_seq_num);
+    } else {
+        LOG_DEBUG(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_GREEN "ACK sent successfully" ANSI_COLOR_RESET "\n");
+    }
+}
+
+/**
+ * @brief Holds back the ACK of an in-order PDU until the next ones or the end of the batch
+ * @return 1 if the ACK is delayed, 0 if it must leave now
+ */
+static int delay_acknowledgement(mic_tcp_sock *sock, mic_tcp_pdu *pdu) {
+    if (sock->ack_pending + 1 >= __atomic_load_n(&sock->ack_every, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+    if (sock->ack_pending == 0) {
+        if (delayed_ack_count == API_BATCH_Size) {
+            return 0;
+        }
+        delayed_acks[delayed_ack_count++] = sock->fd;
+    }
+    sock->ack_pending++;
+    sock->ack_echo = pdu->header.timestamp;
+    return 1;
+}
+
+void flush_delayed_acks(void) {
+    for (int i = 0; i < delayed_ack_count; i++) {
+        mic_tcp_sock *sock = get_socket_by_fd(delayed_acks[i]);
+        // An immediate ACK may have covered the PDUs since
+        if (sock && sock->ack_pending) {
+            send_data_acknowledgement(sock, sock->ack_echo, sock->current_seq_num - 1, 0);
+        }
+    }
+    delayed_ack_count = 0;
+}
+
+void handle_awaiting_closing_state(mic_tcp_pdu* pdu, mic_tcp_sock* sock, int sys_socket, struct sockaddr_in *remote_addr) {
 
     if (verify_pdu(pdu, 0, 1, 0, 0, 0)) {
-        printf(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_GREEN "Final ACK received, connection closed"
+        LOG_INFO(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_GREEN "Final ACK received, connection closed"
                 ANSI_COLOR_RESET "\n");
+        // The application releases the socket with mic_tcp_close, the peer may reconnect meanwhile
+        socket_unhash(sock);
         socket_set_state(sock, CLOSED);
-        socket_cleanup(sock);
+        pthread_cond_broadcast(&sock->cond);
     } else if (verify_pdu(pdu, 0, 0, 1, 0, 0)) {
-        printf(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Received FIN again, initiating closure..." 
+        LOG_INFO(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Received FIN again, initiating closure..." 
                 ANSI_COLOR_RESET "\n");
         mic_tcp_pdu fin_ack = create_nopayload_pdu(0, 1, 1, 0, 0, pdu->header.dest_port, 
                                                     pdu->header.source_port);
         int result = IP_send(sys_socket, fin_ack, remote_addr);
         if (result == -1) {
-            printf(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_RED "Failed to send FIN+ACK" ANSI_COLOR_RESET "\n");
+            LOG_ERROR(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_RED "Failed to send FIN+ACK" ANSI_COLOR_RESET "\n");
         }
     }
 
 }
 
+/**
+ * @brief Sends a SYN+ACK to the peer of a connection being established
+ * @param conn Connection socket
+ */
+static void send_syn_acknowledgement(mic_tcp_sock *conn) {
+    LOG_DEBUG(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Sending SYN+ACK to %s..." ANSI_COLOR_RESET "\n",
+              conn->peer_host);
+    mic_tcp_pdu response = create_nopayload_pdu(1, 1, 0, 0, 0,
+                                               conn->local_addr.port,
+                                               conn->remote_addr.port);
+    if (IP_send(conn->sys_socket, response, &conn->peer_addr) == -1) {
+        LOG_ERROR(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_RED "Failed to send SYN+ACK" ANSI_COLOR_RESET "\n");
+    }
+}
+
+/*
+ * Connection timers: the connections of a listening socket that wait for
+ * their peer are chained through timer_next from listener->timer_head, under
+ * the listener lock. The network thread of the system socket walks this list
+ * after each receive batch (server_check_timeouts). A SYN_RECEIVED
+ * connection resends its SYN+ACK with backoff, and is released after
+ * MAX_ATTEMPTS unanswered ones so a vanished peer does not hold a backlog
+ * place forever.
+ *
+ * A connection closed by its peer (AWAITING_CLOSING) stays hashed to answer
+ * the FINs repeated when its FIN+ACK is lost, even once the application
+ * closed it. It ends on the final ACK, or CLOSE_LINGER_USEC after the last
+ * FIN. A connection closed by the server ends on the FIN+ACK of its peer, or
+ * at the next pass of the network thread when none came.
+ *
+ * Ending a connection (end_connection) unhashes it from the network thread,
+ * which never reaches it again afterwards. Whoever comes last of the network
+ * thread and mic_tcp_close releases it, the decision being taken under
+ * conn->lock: listener_fd is reset once the network thread is done with it.
+ */
+
+/**
+ * @brief Arms the timer of a connection, listener->lock must be held
+ */
+static void arm_connection_timer(mic_tcp_sock *listener, mic_tcp_sock *conn, unsigned long deadline) {
+    if (!conn->timer_armed) {
+        conn->timer_next = listener->timer_head;
+        listener->timer_head = conn->fd;
+        conn->timer_armed = 1;
+    }
+    conn->timer_deadline = deadline;
+}
+
+/**
+ * @brief Removes a connection from the timer list of its listener, listener->lock must be held
+ */
+static void disarm_connection_timer(mic_tcp_sock *listener, mic_tcp_sock *conn) {
+    if (!conn->timer_armed) {
+        return;
+    }
+    int *link = &listener->timer_head;
+    while (*link != -1 && *link != conn->fd) {
+        link = &get_socket_by_fd(*link)->timer_next;
+    }
+    if (*link == conn->fd) {
+        *link = conn->timer_next;
+    }
+    conn->timer_armed = 0;
+}
+
+/**
+ * @brief Delay before the next SYN+ACK of a connection, backed off at each attempt
+ */
+static unsigned long syn_ack_interval(mic_tcp_sock *conn) {
+    unsigned long interval = conn->rto << conn->timer_attempts;
+    return interval < RTO_MAX_USEC ? interval : RTO_MAX_USEC;
+}
+
+/**
+ * @brief (Re)starts the linger timer of a connection closed by its peer
+ */
+static void linger_connection(mic_tcp_sock *conn) {
+    mic_tcp_sock *listener = get_socket_by_fd(conn->listener_fd);
+    if (!listener) {
+        return;
+    }
+    pthread_mutex_lock(&listener->lock);
+    arm_connection_timer(listener, conn, get_now_time_usec() + CLOSE_LINGER_USEC);
+    pthread_mutex_unlock(&listener->lock);
+}
+
+/**
+ * @brief Ends a connection of a listening socket, from the network thread
+ */
+static void end_connection(mic_tcp_sock *conn) {
+    socket_unhash(conn);
+    mic_tcp_sock *listener = get_socket_by_fd(conn->listener_fd);
+    if (listener) {
+        pthread_mutex_lock(&listener->lock);
+        disarm_connection_timer(listener, conn);
+    }
+    pthread_mutex_lock(&conn->lock);
+    conn->state = CLOSED;
+    __atomic_store_n(&conn->listener_fd, -1, __ATOMIC_RELEASE);
+    char release = conn->linger_release;
+    pthread_cond_broadcast(&conn->cond);
+    pthread_mutex_unlock(&conn->lock);
+    if (listener) {
+        pthread_mutex_unlock(&listener->lock);
+    }
+
+    // The application already called mic_tcp_close, nobody else will release it
+    if (release) {
+        stats_log(conn);
+        socket_cleanup(conn);
+    }
+}
+
+int server_linger_close(mic_tcp_sock *conn) {
+    mic_tcp_sock *listener = get_socket_by_fd(__atomic_load_n(&conn->listener_fd, __ATOMIC_ACQUIRE));
+    if (!listener) {
+        return 0;
+    }
+    pthread_mutex_lock(&listener->lock);
+    pthread_mutex_lock(&conn->lock);
+    int lingering = conn->listener_fd != -1;
+    if (lingering) {
+        conn->linger_release = 1;
+        // A lingering connection already has its timer, one whose FIN went unanswered ends at the next pass
+        if (conn->state != AWAITING_CLOSING) {
+            arm_connection_timer(listener, conn, get_now_time_usec());
+        }
+    }
+    pthread_mutex_unlock(&conn->lock);
+    pthread_mutex_unlock(&listener->lock);
+    return lingering;
+}
+
+/**
+ * @brief Creates the socket of a new connection and answers its SYN
+ * @param listener Listening socket that received the SYN
+ * @param pdu Received SYN
+ * @param remote_addr System address of the new peer
+ */
+static void accept_new_connection(mic_tcp_sock *listener, mic_tcp_pdu *pdu, struct sockaddr_in *remote_addr) {
+    // Reserve a backlog place first, the SYN is dropped (and retried by the client) when it is full
+    pthread_mutex_lock(&listener->lock);
+    if (listener->backlog_count + listener->backlog_pending >= ACCEPT_BACKLOG) {
+        pthread_mutex_unlock(&listener->lock);
+        LOG_WARN(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_RED "Accept backlog full, SYN dropped" ANSI_COLOR_RESET "\n");
+        return;
+    }
+    listener->backlog_pending++;
+    pthread_mutex_unlock(&listener->lock);
+
+    int fd = allocate_new_socket(listener->sys_socket);
+    mic_tcp_sock *conn = get_socket_by_fd(fd);
+    if (!conn || app_buffer_init(&conn->recv_buffer) != 0 || reorder_buffer_init(conn) != 0) {
+        LOG_ERROR(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_RED "Failed to allocate connection socket" ANSI_COLOR_RESET "\n");
+        if (conn) {
+            app_buffer_free(&conn->recv_buffer);
+            release_socket(conn);
+        }
+        pthread_mutex_lock(&listener->lock);
+        listener->backlog_pending--;
+        pthread_mutex_unlock(&listener->lock);
+        return;
+    }
+
+    conn->shares_sys_socket = 1;
+    conn->listener_fd = listener->fd;
+    conn->ack_every = __atomic_load_n(&listener->ack_every, __ATOMIC_RELAXED);
+    conn->local_addr = listener->local_addr;
+    // The peer address is kept in binary form for every later send
+    conn->peer_addr = *remote_addr;
+    inet_ntop(AF_INET, &remote_addr->sin_addr, conn->peer_host, sizeof(conn->peer_host));
+    conn->remote_addr.ip_addr.addr = conn->peer_host;
+    conn->remote_addr.ip_addr.addr_size = strlen(conn->peer_host) + 1;
+    conn->remote_addr.port = pdu->header.source_port;
+    socket_set_state(conn, SYN_RECEIVED);
+    socket_set_peer(conn, remote_addr);
+
+    LOG_INFO(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_GREEN "SYN received from %s:%d, connection FD %d" ANSI_COLOR_RESET "\n",
+             conn->peer_host, ntohs(remote_addr->sin_port), fd);
+    send_syn_acknowledgement(conn);
+
+    pthread_mutex_lock(&listener->lock);
+    arm_connection_timer(listener, conn, get_now_time_usec() + syn_ack_interval(conn));
+    pthread_mutex_unlock(&listener->lock);
+}
+
+/**
+ * @brief Moves a connection to ESTABLISHED and hands it to mic_tcp_accept
+ * @param conn Connection socket
+ */
+static void establish_connection(mic_tcp_sock *conn) {
+    pthread_mutex_lock(&conn->lock);
+    conn->state = ESTABLISHED;
+    conn->current_seq_num = 1;
+    pthread_mutex_unlock(&conn->lock);
+
+    mic_tcp_sock *listener = get_socket_by_fd(conn->listener_fd);
+    if (!listener) {
+        return;
+    }
+    pthread_mutex_lock(&listener->lock);
+    disarm_connection_timer(listener, conn);
+    listener->accept_backlog[(listener->backlog_head + listener->backlog_count) % ACCEPT_BACKLOG] = conn->fd;
+    listener->backlog_count++;
+    listener->backlog_pending--;
+    pthread_cond_broadcast(&listener->cond);
+    pthread_mutex_unlock(&listener->lock);
+}
+
+unsigned long server_check_timeouts(int sys_socket) {
+    mic_tcp_sock *listener = get_socket_by_sys_fd(sys_socket);
+    if (!listener) {
+        return 0;
+    }
+    unsigned long now = get_now_time_usec();
+    unsigned long next = 0;
+    int armed = 0;
+    int expired = -1;
+
+    pthread_mutex_lock(&listener->lock);
+    int *link = &listener->timer_head;
+    while (*link != -1) {
+        mic_tcp_sock *conn = get_socket_by_fd(*link);
+        if (now >= conn->timer_deadline) {
+            // Connections to end are moved to a local list, released once the listener lock is dropped
+            if (conn->state != SYN_RECEIVED || conn->timer_attempts >= MAX_ATTEMPTS) {
+                *link = conn->timer_next;
+                conn->timer_armed = 0;
+                if (conn->state == SYN_RECEIVED) {
+                    listener->backlog_pending--;
+                }
+                conn->timer_next = expired;
+                expired = conn->fd;
+                continue;
+            }
+            conn->timer_attempts++;
+            LOG_DEBUG(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Final ACK not received, resending SYN+ACK "
+                      "(Attempt %d)..." ANSI_COLOR_RESET "\n", conn->timer_attempts + 1);
+            send_syn_acknowledgement(conn);
+            conn->timer_deadline = now + syn_ack_interval(conn);
+        }
+        unsigned long remaining = conn->timer_deadline - now;
+        if (!armed || remaining < next) {
+            next = remaining;
+        }
+        armed = 1;
+        link = &conn->timer_next;
+    }
+    pthread_mutex_unlock(&listener->lock);
+
+    // socket_unhash and socket_cleanup take the socket table lock, never under a socket lock
+    while (expired != -1) {
+        mic_tcp_sock *conn = get_socket_by_fd(expired);
+        expired = conn->timer_next;
+        conn->timer_next = -1;
+        if (conn->state == AWAITING_CLOSING) {
+            LOG_INFO(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "No final ACK from %s, connection FD %d closed"
+                     ANSI_COLOR_RESET "\n", conn->peer_host, conn->fd);
+            end_connection(conn);
+        } else if (conn->state != SYN_RECEIVED) {
+            end_connection(conn);
+        } else {
+            LOG_WARN(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_RED "No final ACK from %s after %d SYN+ACK, "
+                     "connection FD %d dropped" ANSI_COLOR_RESET "\n", conn->peer_host, MAX_ATTEMPTS, conn->fd);
+            socket_unhash(conn);
+            socket_set_state(conn, CLOSED);
+            socket_cleanup(conn);
+        }
+    }
+
+    if (!armed) {
+        return 0;
+    }
+    next = (next + 999) / 1000;
+    return next > 0 ? next : 1;
+}
+
 /**
  * @brief Processes incoming PDUs based on socket state
  * @param sys_socket System socket descriptor
  * @param pdu Received PDU
- * @param local_addr Local address
- * @param remote_addr Remote address
+ * @param remote_addr System address the PDU was received from
  */
-void process_server_PDU(int sys_socket, mic_tcp_pdu pdu, mic_tcp_ip_addr local_addr, mic_tcp_ip_addr remote_addr) {
-    printf(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_MAGENTA "Processing server PDU..." ANSI_COLOR_RESET "\n");
+void process_server_PDU(int sys_socket, mic_tcp_pdu pdu, struct sockaddr_in *remote_addr) {
+    LOG_DEBUG(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_MAGENTA "Processing server PDU..." ANSI_COLOR_RESET "\n");
     
-    mic_tcp_sock *sock = get_socket_by_sys_fd(sys_socket);
+    mic_tcp_sock *sock = get_socket_by_peer(sys_socket, remote_addr);
     if (!sock) {
-        printf(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_RED "No socket found for system FD %d" ANSI_COLOR_RESET "\n", sys_socket);
+        LOG_ERROR(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_RED "No socket found for system FD %d" ANSI_COLOR_RESET "\n", sys_socket);
+        return;
+    }
+
+    // PDUs of unknown peers reach the listening socket, which only handles connection requests
+    if (sock->accept_backlog) {
+        if (sock->state == ACCEPTING && verify_pdu(&pdu, 1, 0, 0, 0, 0)) {
+            accept_new_connection(sock, &pdu, remote_addr);
+        } else {
+            LOG_WARN(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "PDU from unknown peer ignored" ANSI_COLOR_RESET "\n");
+        }
         return;
     }
 
-    if (sock->state != AWAITING_CLOSING && verify_pdu(&pdu, 0, 0, 1, 0, 0)) {
-        printf(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Received FIN, initiating closure..." 
+    // A FIN during the handshake also acknowledges our SYN+ACK, it is handled once established
+    if (sock->state != AWAITING_CLOSING && sock->state != SYN_RECEIVED && verify_pdu(&pdu, 0, 0, 1, 0, 0)) {
+        LOG_INFO(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Received FIN, initiating closure..." 
                 ANSI_COLOR_RESET "\n");
         socket_set_state(sock, AWAITING_CLOSING);
+        // The PDUs held past a gap the sender gave up were acknowledged by SACK, they are not lost
+        if (sock->reorder_buffer) {
+            reorder_buffer_skip(sock, pdu.header.ack_num);
+        }
+        if (sock->ack_pending) {
+            send_data_acknowledgement(sock, sock->ack_echo, sock->current_seq_num - 1, 0);
+        }
+        // Every data PDU was acknowledged or skipped before the FIN, mic_tcp_recv reports the end of stream
+        if (sock->recv_buffer.data) {
+            app_buffer_close(&sock->recv_buffer);
+        }
         
         mic_tcp_pdu fin_ack = create_nopayload_pdu(0, 1, 1, 0, 0,
                                                     pdu.header.dest_port,
                                                     pdu.header.source_port);
         int result = IP_send(sys_socket, fin_ack, remote_addr);
         if (result == -1) {
-            printf(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_RED "Failed to send FIN+ACK" ANSI_COLOR_RESET "\n");
+            LOG_ERROR(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_RED "Failed to send FIN+ACK" ANSI_COLOR_RESET "\n");
         }
+        linger_connection(sock);
         return;
     }
     
     switch (sock->state) {
-        case ACCEPTING:
-            if (verify_pdu(&pdu, 1, 0, 0, 0, 0)) {
-                printf(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_GREEN "SYN received" ANSI_COLOR_RESET "\n");
-                socket_set_state(sock, SYN_RECEIVED);
-                sock->remote_addr.ip_addr = remote_addr;
-                sock->remote_addr.port = pdu.header.source_port;
-                pthread_cond_signal(&sock->cond);
-            }
-            break;
-            
         case SYN_RECEIVED:
-            if (verify_pdu(&pdu, 0, 1, 0, 0, 0)) {
-                printf(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_GREEN "ACK received, connection established" 
-                       ANSI_COLOR_RESET "\n");
-                socket_set_state(sock, ESTABLISHED);
-                sock->current_seq_num = 1;
-                pthread_cond_signal(&sock->cond);
+            if (verify_pdu(&pdu, 1, 0, 0, 0, 0)) { // Our SYN+ACK was lost, the client asks again
+                send_syn_acknowledgement(sock);
+                break;
+            }
+            if (pdu.header.syn) {
+                break;
+            }
+            LOG_INFO(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_GREEN "ACK received, connection established" 
+                     ANSI_COLOR_RESET "\n");
+            establish_connection(sock);
+            if (!verify_pdu(&pdu, 0, 1, 0, 0, 0)) {
+                // The final ACK was lost but the client already sends: its PDU acknowledges our SYN+ACK
+                process_server_PDU(sys_socket, pdu, remote_addr);
             }
             break;
             
         case ESTABLISHED:
             if (verify_pdu(&pdu, 0, 0, 0, 0, 0)) {
-                if (strcmp(pdu.payload.data, MESURING_PAYLOAD) == 0) {
-                    printf(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Received measurement packet, sending ACK..." 
-                           ANSI_COLOR_RESET "\n");
-                    mic_tcp_pdu acknowledgment = create_nopayload_pdu(0, 1, 0, 0, 0,
+                if (probe_is_probe(&pdu)) {
+                    LOG_DEBUG(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Received probe %d, sending ACK..." 
+                              ANSI_COLOR_RESET "\n", pdu.header.seq_num);
+                    // The probe number goes back in seq_num, ack_num 0 keeps it apart from data ACKs
+                    mic_tcp_pdu acknowledgment = create_nopayload_pdu(0, 1, 0, pdu.header.seq_num, 0,
                                                                     pdu.header.dest_port,
                                                                     pdu.header.source_port);
-                    IP_send(sys_socket, acknowledgment, sock->remote_addr.ip_addr);
+                    acknowledgment.header.timestamp_echo = pdu.header.timestamp;
+                    acknowledgment.header.window = app_buffer_space(&sock->recv_buffer);
+                    IP_send(sys_socket, acknowledgment, &sock->peer_addr);
                     break;
                 }
                 
-                printf(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Received data packet (Seq: %d, Expected: %d)" 
-                       ANSI_COLOR_RESET "\n", pdu.header.seq_num, sock->current_seq_num);
-                
-                if (verify_pdu(&pdu, 0, 0, 0, sock->current_seq_num, 0)) {
-                    sock->current_seq_num++;
-                    printf(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_GREEN "Data packet Accepted, using %d Bytes" 
-                           ANSI_COLOR_RESET "\n", pdu.payload.size);
-                    app_buffer_put(pdu.payload);
+                // An empty PDU (zero window probe, or notice of PDUs given up) asks for an ACK carrying the window
+                if (pdu.payload.size == 0) {
+                    reorder_buffer_skip(sock, pdu.header.ack_num);
+                    LOG_DEBUG(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Received window probe, %u B free" 
+                              ANSI_COLOR_RESET "\n", app_buffer_space(&sock->recv_buffer));
+                    mic_tcp_pdu acknowledgment = create_nopayload_pdu(0, 1, 0, 0,
+                                                                    sock->current_seq_num,
+                                                                    pdu.header.dest_port,
+                                                                    pdu.header.source_port);
+                    acknowledgment.header.window = app_buffer_space(&sock->recv_buffer);
+                    IP_send(sys_socket, acknowledgment, &sock->peer_addr);
+                    break;
                 }
                 
-                printf(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Sending ACK (Ack: %d)..." ANSI_COLOR_RESET "\n",
-                       sock->current_seq_num);
-                mic_tcp_pdu acknowledgment = create_nopayload_pdu(0, 1, 0, 0,
-                                                                sock->current_seq_num,
-                                                                pdu.header.dest_port,
-                                                                pdu.header.source_port);
-                int result = IP_send(sys_socket, acknowledgment, sock->remote_addr.ip_addr);
-                if (result == -1) {
-                    printf(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_RED "Failed to send ACK for Seq %d" 
-                           ANSI_COLOR_RESET "\n", sock->current_seq_num);
-                } else {
-                    printf(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_GREEN "ACK sent successfully" ANSI_COLOR_RESET "\n");
+                LOG_DEBUG(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Received data packet (Seq: %d, Expected: %d)" 
+                          ANSI_COLOR_RESET "\n", pdu.header.seq_num, sock->current_seq_num);
+                STATS_ADD(sock, packets_received, 1);
+                STATS_ADD(sock, bytes_received, pdu.payload.size);
+                unsigned int expected = sock->current_seq_num;
+                int gap = reorder_buffer_receive(sock, &pdu);
+                
+                // Only a PDU that simply extends the in-order data may wait for the next ones
+                int in_order = pdu.header.seq_num == expected && sock->current_seq_num == expected + 1
+                               && sock->reorder_held == 0;
+                if (!in_order || !delay_acknowledgement(sock, &pdu)) {
+                    send_data_acknowledgement(sock, pdu.header.timestamp, pdu.header.seq_num, gap);
                 }
             }
             break;
             
         case AWAITING_CLOSING:
-            handle_awaiting_closing_state(&pdu, sock, sys_socket, local_addr, remote_addr);
+            if (verify_pdu(&pdu, 0, 1, 0, 0, 0)) {
+                LOG_INFO(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_GREEN "Final ACK received, connection closed"
+                         ANSI_COLOR_RESET "\n");
+                end_connection(sock);
+            } else if (verify_pdu(&pdu, 0, 0, 1, 0, 0)) {
+                // Our FIN+ACK was lost, answer again and keep lingering
+                handle_awaiting_closing_state(&pdu, sock, sys_socket, remote_addr);
+                linger_connection(sock);
+            }
             break;
         
         case CLOSING:
             if (verify_pdu(&pdu, 0, 1, 1, 0, 0)) {
-                printf(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Received FIN+ACK..." 
-                       ANSI_COLOR_RESET "\n");
-                pthread_cond_signal(&sock->cond);
-                
+                LOG_INFO(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Received FIN+ACK..." 
+                         ANSI_COLOR_RESET "\n");
+                // mic_tcp_close wakes up to send the final ACK and release the connection
+                end_connection(sock);
+
             }
             break;
             
         case IDLE:
+        case ACCEPTING:
         case CLOSED:
         case SYN_SENT:
         case MEASURING_RELIABILITY:
-            printf(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "PDU ignored in state %d" ANSI_COLOR_RESET "\n",
-                   sock->state);
+            LOG_DEBUG(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "PDU ignored in state %d" ANSI_COLOR_RESET "\n",
+                      sock->state);
             break;
     }
 }
 
 
-void listening_client(int sys_socket) {
-    printf(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_CYAN "Client listening thread started for sys FD %d" ANSI_COLOR_RESET "\n", sys_socket);
+void listening_client(int fd) {
+    LOG_INFO(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_CYAN "Client listening thread started for FD %d" ANSI_COLOR_RESET "\n", fd);
     
+    // Reception buffers are reused for every batch, ACKs carry no payload
+    mic_tcp_pdu pdus[API_BATCH_Size];
+    struct sockaddr_in remote_addrs[API_BATCH_Size];
+    for (int i = 0; i < API_BATCH_Size; i++) {
+        pdus[i].payload.data = NULL;
+    }
+
     while (1) {
-        mic_tcp_sock *sock = get_socket_by_sys_fd(sys_socket);
+        mic_tcp_sock *sock = get_socket_by_fd(fd);
         if (!sock || sock->state == CLOSED) {
-            printf(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Socket closed or invalid, exiting listening thread" ANSI_COLOR_RESET "\n");
+            LOG_INFO(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Socket closed or invalid, exiting listening thread" ANSI_COLOR_RESET "\n");
             break;
         }
+        int sys_socket = sock->sys_socket;
         
-        mic_tcp_pdu pdu;
-        pdu.payload.size = 0;
-        mic_tcp_ip_addr local_addr, remote_addr;
-        
-        int result = IP_recv(sys_socket, &pdu, &local_addr, &remote_addr, 0);
-        if (result == -1) {
-            printf(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "No packet received, continuing..." ANSI_COLOR_RESET "\n");
-            continue;
+        for (int i = 0; i < API_BATCH_Size; i++) {
+            pdus[i].payload.size = 0;
         }
         
-        process_client_PDU(sys_socket, pdu, local_addr, remote_addr);
+        // Wake up at the latest when the next retransmission timer expires
+        int count = IP_recv_batch(sys_socket, pdus, remote_addrs, API_BATCH_Size, send_window_next_timeout(sock));
+        
+        // Retransmissions and FIN+ACK replies of this round leave in a single batch
+        IP_send_batch_begin();
+        for (int i = 0; i < count; i++) {
+            process_client_PDU(sys_socket, pdus[i], &remote_addrs[i]);
+        }
+        send_window_check_timeouts(sock);
+        IP_send_batch_flush();
     }
 }
 
-void process_client_PDU(int sys_socket, mic_tcp_pdu pdu, mic_tcp_ip_addr local_addr, mic_tcp_ip_addr remote_addr) {
+void process_client_PDU(int sys_socket, mic_tcp_pdu pdu, struct sockaddr_in *remote_addr) {
 
-    printf(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_MAGENTA "Processing client PDU..." ANSI_COLOR_RESET "\n");
+    LOG_DEBUG(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_MAGENTA "Processing client PDU..." ANSI_COLOR_RESET "\n");
     
-    mic_tcp_sock *sock = get_socket_by_sys_fd(sys_socket);
+    mic_tcp_sock *sock = get_socket_by_peer(sys_socket, remote_addr);
     if (!sock) {
-        printf(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_RED "No socket found for System FD %d" ANSI_COLOR_RESET "\n", sys_socket);
+        LOG_ERROR(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_RED "No socket found for System FD %d" ANSI_COLOR_RESET "\n", sys_socket);
         return;
     }
 
@@ -183,11 +588,8 @@ void process_client_PDU(int sys_socket, mic_tcp_pdu pdu, mic_tcp_ip_addr local_a
     switch (sock->state) {
 
         case MEASURING_RELIABILITY:
-            if (verify_pdu(&pdu, 0, 1, 0, 0, 0)) { // Measuring ACK
-                pthread_mutex_lock(&sock->lock);
-                sock->received_packets++;
-                pthread_mutex_unlock(&sock->lock);
-                pthread_cond_signal(&sock->cond); // Signal that an ACK was received
+            if (verify_pdu(&pdu, 0, 1, 0, 0, 0)) { // Probe ACK
+                probe_acknowledge(sock, &pdu);
             }
             break;
 
@@ -195,34 +597,34 @@ void process_client_PDU(int sys_socket, mic_tcp_pdu pdu, mic_tcp_ip_addr local_a
             
             if (verify_pdu(&pdu, 0, 1, 0, 0, 0)) { // Data ACK
 
-                printf(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Received data ACK..." 
-                       ANSI_COLOR_RESET "\n");
-                sock->current_seq_num = pdu.header.ack_num;
-                pthread_cond_signal(&sock->cond);
+                LOG_DEBUG(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Received data ACK..." 
+                          ANSI_COLOR_RESET "\n");
+                send_window_acknowledge(sock, &pdu);
 
             } else if (verify_pdu(&pdu, 0, 0, 1, 0, 0)) {
 
-                printf(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Received FIN, initiating closure..." 
-                       ANSI_COLOR_RESET "\n");
+                LOG_INFO(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Received FIN, initiating closure..." 
+                         ANSI_COLOR_RESET "\n");
                 socket_set_state(sock, AWAITING_CLOSING);
                 
                 mic_tcp_pdu fin_ack = create_nopayload_pdu(0, 1, 1, 0, 0, pdu.header.dest_port, 
                                                           pdu.header.source_port);
                 int result = IP_send(sys_socket, fin_ack, remote_addr);
                 if (result == -1) {
-                    printf(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_RED "Failed to send FIN+ACK" ANSI_COLOR_RESET "\n");
+                    LOG_ERROR(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_RED "Failed to send FIN+ACK" ANSI_COLOR_RESET "\n");
                 }
             }
             break;
             
         case AWAITING_CLOSING:
-            handle_awaiting_closing_state(&pdu, sock, sys_socket, local_addr, remote_addr);
+            handle_awaiting_closing_state(&pdu, sock, sys_socket, remote_addr);
             break;
 
         case CLOSING:
             if (verify_pdu(&pdu, 0, 1, 1, 0, 0)) {
-                printf(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Received FIN+ACK..." 
-                       ANSI_COLOR_RESET "\n");
+                LOG_INFO(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Received FIN+ACK..." 
+                         ANSI_COLOR_RESET "\n");
+                socket_set_state(sock, CLOSED);
                 pthread_cond_signal(&sock->cond);
             }
             break;
@@ -232,8 +634,8 @@ void process_client_PDU(int sys_socket, mic_tcp_pdu pdu, mic_tcp_ip_addr local_a
         case SYN_SENT:
         case ACCEPTING:
         case SYN_RECEIVED:
-            printf(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "PDU ignored in state %d" ANSI_COLOR_RESET "\n", 
-                   sock->state);
+            LOG_DEBUG(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "PDU ignored in state %d" ANSI_COLOR_RESET "\n", 
+                      sock->state);
             break;
     }
     
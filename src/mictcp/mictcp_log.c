@@ -0,0 +1,185 @@
+#include "mictcp/mictcp_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <limits.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+/*
+ * Every thread logging for the first time gets its own ring of
+ * LOG_RING_SLOTS records. The thread formats its records in place and
+ * publishes them by moving tail; the log writer thread is the only consumer,
+ * it writes them to stderr and moves head. A full ring drops the record
+ * instead of blocking the protocol. The writer only sleeps (futex on
+ * writer_wakeups) once every ring is empty, a producer only wakes it up when
+ * it sleeps.
+ *
+ * The rings are chained in a list protected by rings_lock, also held by the
+ * consumer while draining. When a thread exits, its ring is marked orphaned
+ * and freed by the consumer once emptied.
+ */
+
+typedef struct log_ring
+{
+    char records[LOG_RING_SLOTS][LOG_RECORD_SIZE];
+    unsigned int head;          /* prochain enregistrement à écrire, modifié par le consommateur */
+    unsigned int tail;          /* prochain emplacement libre, modifié par le thread propriétaire */
+    unsigned long dropped;      /* enregistrements perdus faute de place */
+    unsigned long reported;     /* pertes déjà signalées par le consommateur */
+    int orphaned;               /* 1 une fois le thread propriétaire terminé */
+    struct log_ring *next;
+} log_ring;
+
+static __thread log_ring *thread_ring = NULL;
+static log_ring *rings = NULL;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t log_once = PTHREAD_ONCE_INIT;
+static pthread_key_t ring_key;
+static unsigned int writer_waiting = 0;
+static unsigned int writer_wakeups = 0;
+
+static void futex_wait(unsigned int *addr, unsigned int expected) {
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+static void futex_wake(unsigned int *addr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+/**
+ * @brief Writes the pending records of every ring, rings_lock must be held
+ * @return Number of records written
+ */
+static int drain_rings(void) {
+    int written = 0;
+    log_ring **link = &rings;
+
+    while (*link) {
+        log_ring *ring = *link;
+        int orphaned = __atomic_load_n(&ring->orphaned, __ATOMIC_ACQUIRE);
+        unsigned int tail = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+
+        while (ring->head != tail) {
+            fputs(ring->records[ring->head & (LOG_RING_SLOTS - 1)], stderr);
+            __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+            written++;
+        }
+
+        unsigned long dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+        if (dropped != ring->reported) {
+            fprintf(stderr, "[MICTCP-LOG] %lu enregistrements perdus\n", dropped - ring->reported);
+            ring->reported = dropped;
+        }
+
+        if (orphaned) {
+            *link = ring->next;
+            free(ring);
+        } else {
+            link = &ring->next;
+        }
+    }
+
+    if (written > 0) {
+        fflush(stderr);
+    }
+    return written;
+}
+
+static void *log_writer(void *arg) {
+    (void) arg;
+
+    while (1) {
+        pthread_mutex_lock(&rings_lock);
+        int written = drain_rings();
+        pthread_mutex_unlock(&rings_lock);
+        if (written > 0) {
+            continue;
+        }
+
+        /* The wakeup counter is read before draining the rings one last time:
+           a record published after that drain bumps the counter, and the futex
+           then returns immediately instead of sleeping */
+        unsigned int wakeups = __atomic_load_n(&writer_wakeups, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&writer_waiting, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_lock(&rings_lock);
+        written = drain_rings();
+        pthread_mutex_unlock(&rings_lock);
+        if (written == 0) {
+            futex_wait(&writer_wakeups, wakeups);
+        }
+        __atomic_store_n(&writer_waiting, 0, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+static void orphan_ring(void *arg) {
+    log_ring *ring = arg;
+    __atomic_store_n(&ring->orphaned, 1, __ATOMIC_RELEASE);
+}
+
+static void log_start(void) {
+    pthread_t writer;
+
+    pthread_key_create(&ring_key, orphan_ring);
+    atexit(log_flush);
+    if (pthread_create(&writer, NULL, log_writer, NULL) == 0) {
+        pthread_detach(writer);
+    }
+}
+
+static log_ring *register_ring(void) {
+    log_ring *ring = calloc(1, sizeof(log_ring));
+    if (!ring) {
+        return NULL;
+    }
+    pthread_setspecific(ring_key, ring);
+
+    pthread_mutex_lock(&rings_lock);
+    ring->next = rings;
+    rings = ring;
+    pthread_mutex_unlock(&rings_lock);
+
+    thread_ring = ring;
+    return ring;
+}
+
+void log_write(const char *format, ...) {
+    pthread_once(&log_once, log_start);
+
+    log_ring *ring = thread_ring ? thread_ring : register_ring();
+    if (!ring) {
+        return;
+    }
+
+    unsigned int tail = ring->tail;
+    if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) >= LOG_RING_SLOTS) {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    char *record = ring->records[tail & (LOG_RING_SLOTS - 1)];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(record, LOG_RECORD_SIZE, format, args);
+    va_end(args);
+
+    // A truncated record still ends the line
+    if (length >= LOG_RECORD_SIZE) {
+        record[LOG_RECORD_SIZE - 2] = '\n';
+    }
+    // Publish the record, then wake the writer only if it is asleep
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&writer_waiting, __ATOMIC_SEQ_CST)) {
+        __atomic_fetch_add(&writer_wakeups, 1, __ATOMIC_SEQ_CST);
+        futex_wake(&writer_wakeups);
+    }
+}
+
+void log_flush(void) {
+    pthread_mutex_lock(&rings_lock);
+    drain_rings();
+    pthread_mutex_unlock(&rings_lock);
+}
@@ -1,6 +1,8 @@
 #include "mictcp/mictcp_pdu.h"
 #include <stdio.h>
 #include "mictcp/mictcp_config.h"
+#include "mictcp/mictcp_log.h"
+#include "api/mictcp_core.h"
 
 /**
  * @brief Constructs a MIC-TCP PDU with empty payload
@@ -29,15 +31,25 @@ mic_tcp_pdu create_nopayload_pdu(char syn, char ack, char fin, int seq_num, int
     pdu_header.syn = syn;
     pdu_header.ack = ack;
     pdu_header.fin = fin;
+    pdu_header.nack = 0;
     pdu_header.seq_num = seq_num;
     pdu_header.ack_num = ack_num;
     
+    // Sending date, echoed back by the peer for RTT measurement (0 means "no timestamp")
+    pdu_header.timestamp = (unsigned int) get_now_time_usec();
+    if (pdu_header.timestamp == 0) {
+        pdu_header.timestamp = 1;
+    }
+    pdu_header.timestamp_echo = 0;
+    pdu_header.window = 0;
+    memset(pdu_header.sack, 0, sizeof(pdu_header.sack));
+    
     // Combine header and payload
     pdu.header = pdu_header;
     pdu.payload = pdu_payload;
     
-    printf(LOG_PREFIX ANSI_COLOR_GREEN "PDU created: SYN=%d ACK=%d FIN=%d SEQ=%d ACK_NUM=%d" 
-           ANSI_COLOR_RESET "\n", syn, ack, fin, seq_num, ack_num);
+    LOG_DEBUG(LOG_PREFIX ANSI_COLOR_GREEN "PDU created: SYN=%d ACK=%d FIN=%d SEQ=%d ACK_NUM=%d" 
+              ANSI_COLOR_RESET "\n", syn, ack, fin, seq_num, ack_num);
     
     return pdu;
 }
@@ -1,37 +1,199 @@
 #include "mictcp/mictcp_sock_lookup.h"
 #include "mictcp/mictcp_config.h"
+#include "mictcp/mictcp_log.h"
+#include "mictcp/rtt_estimator.h"
 #include <stdio.h>
 
-static int next_fd = 0;
-socket_entry_t sockets[MAX_SOCKETS];
+/*
+ * Sockets are stored in chunks of SOCKET_CHUNK_SIZE entries allocated on
+ * demand, so the fd directly indexes its entry and a mic_tcp_sock never moves
+ * once handed out. Closed entries go back on a free list and their fd is
+ * reused by the next allocation.
+ *
+ * PDUs are dispatched through a chained hash keyed by (sys_socket, peer).
+ * A socket without peer (listening, or not connected yet) is hashed with an
+ * AF_UNSPEC peer and catches the PDUs of unknown peers on its sys_socket.
+ *
+ * Allocation, release and the hash are protected by table_lock. Chunks are
+ * published with release stores, so lookups by fd take no lock.
+ */
 
-mic_tcp_sock *get_socket_by_fd(int fd) {
-    for (int i = 0; i < MAX_SOCKETS; i++) {
-        if (sockets[i].is_used && sockets[i].sock.fd == fd) {
-            return &sockets[i].sock;
+#define SOCKET_CHUNK_COUNT ((MAX_SOCKETS + SOCKET_CHUNK_SIZE - 1) / SOCKET_CHUNK_SIZE)
+
+static socket_entry_t *chunks[SOCKET_CHUNK_COUNT];
+static int allocated_fds = 0;   /* fds covered by the allocated chunks */
+static int free_head = -1;
+
+static int *buckets = NULL;
+static unsigned int bucket_count = 0;
+static unsigned int hashed_sockets = 0;
+
+static pthread_rwlock_t table_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static socket_entry_t *get_entry(int fd) {
+    if (fd < 0 || fd >= MAX_SOCKETS) {
+        return NULL;
+    }
+    socket_entry_t *chunk = __atomic_load_n(&chunks[fd / SOCKET_CHUNK_SIZE], __ATOMIC_ACQUIRE);
+    return chunk ? &chunk[fd % SOCKET_CHUNK_SIZE] : NULL;
+}
+
+static unsigned int hash_key(int sys_socket, const struct sockaddr_in *peer) {
+    unsigned int hash = (unsigned int) sys_socket * 0x9E3779B1u;
+    if (peer && peer->sin_family == AF_INET) {
+        hash ^= peer->sin_addr.s_addr * 0x85EBCA6Bu;
+        hash ^= (unsigned int) peer->sin_port * 0xC2B2AE35u;
+    }
+    return hash ^ (hash >> 16);
+}
+
+static int same_peer(const struct sockaddr_in *a, const struct sockaddr_in *b) {
+    if (a->sin_family != AF_INET || !b || b->sin_family != AF_INET) {
+        return a->sin_family != AF_INET && (!b || b->sin_family != AF_INET);
+    }
+    return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+/**
+ * @brief Finds the entry matching exactly (sys_socket, peer), table_lock must be held
+ */
+static socket_entry_t *hash_find(int sys_socket, const struct sockaddr_in *peer) {
+    if (!buckets) {
+        return NULL;
+    }
+    int fd = buckets[hash_key(sys_socket, peer) & (bucket_count - 1)];
+    while (fd != -1) {
+        socket_entry_t *entry = get_entry(fd);
+        if (entry->sock.sys_socket == sys_socket && same_peer(&entry->peer, peer)) {
+            return entry;
         }
+        fd = entry->hash_next;
     }
     return NULL;
 }
 
-mic_tcp_sock *get_socket_by_sys_fd(int sys_socket) {
-    for (int i = 0; i < MAX_SOCKETS; i++) {
-        if (sockets[i].is_used && sockets[i].sock.sys_socket == sys_socket) {
-            return &sockets[i].sock;
+static void hash_insert(socket_entry_t *entry) {
+    unsigned int bucket = hash_key(entry->sock.sys_socket, &entry->peer) & (bucket_count - 1);
+    entry->hash_next = buckets[bucket];
+    buckets[bucket] = entry->sock.fd;
+    entry->is_hashed = 1;
+    hashed_sockets++;
+}
+
+static void hash_remove(socket_entry_t *entry) {
+    if (!entry->is_hashed) {
+        return;
+    }
+    entry->is_hashed = 0;
+    int *link = &buckets[hash_key(entry->sock.sys_socket, &entry->peer) & (bucket_count - 1)];
+    while (*link != -1) {
+        if (*link == entry->sock.fd) {
+            *link = entry->hash_next;
+            hashed_sockets--;
+            return;
         }
+        link = &get_entry(*link)->hash_next;
     }
-    return NULL;
+}
+
+/**
+ * @brief Doubles the bucket array once the load factor reaches 1, table_lock must be held
+ */
+static int hash_grow(void) {
+    unsigned int new_count = bucket_count ? bucket_count * 2 : SOCKET_CHUNK_SIZE;
+    int *new_buckets = malloc(new_count * sizeof(int));
+    if (!new_buckets) {
+        return -1;
+    }
+    for (unsigned int i = 0; i < new_count; i++) {
+        new_buckets[i] = -1;
+    }
+
+    int *old_buckets = buckets;
+    unsigned int old_count = bucket_count;
+    buckets = new_buckets;
+    bucket_count = new_count;
+    hashed_sockets = 0;
+
+    for (unsigned int i = 0; i < old_count; i++) {
+        int fd = old_buckets[i];
+        while (fd != -1) {
+            socket_entry_t *entry = get_entry(fd);
+            int next = entry->hash_next;
+            hash_insert(entry);
+            fd = next;
+        }
+    }
+    free(old_buckets);
+    return 0;
+}
+
+/**
+ * @brief Allocates the next chunk and pushes its fds on the free list, table_lock must be held
+ */
+static int grow_table(void) {
+    if (allocated_fds >= MAX_SOCKETS) {
+        return -1;
+    }
+    socket_entry_t *chunk = calloc(SOCKET_CHUNK_SIZE, sizeof(socket_entry_t));
+    if (!chunk) {
+        return -1;
+    }
+    int first_fd = allocated_fds;
+    int last_fd = first_fd + SOCKET_CHUNK_SIZE < MAX_SOCKETS ? first_fd + SOCKET_CHUNK_SIZE : MAX_SOCKETS;
+    for (int fd = last_fd - 1; fd >= first_fd; fd--) {
+        chunk[fd - first_fd].next_free = free_head;
+        free_head = fd;
+    }
+    __atomic_store_n(&chunks[first_fd / SOCKET_CHUNK_SIZE], chunk, __ATOMIC_RELEASE);
+    allocated_fds = last_fd;
+
+    LOG_INFO(LOG_PREFIX ANSI_COLOR_GREEN "Socket table grown to %d entries" ANSI_COLOR_RESET "\n", allocated_fds);
+    return 0;
+}
+
+mic_tcp_sock *get_socket_by_fd(int fd) {
+    socket_entry_t *entry = get_entry(fd);
+    return entry && entry->is_used ? &entry->sock : NULL;
+}
+
+mic_tcp_sock *get_socket_by_sys_fd(int sys_socket) {
+    pthread_rwlock_rdlock(&table_lock);
+    socket_entry_t *entry = hash_find(sys_socket, NULL);
+    pthread_rwlock_unlock(&table_lock);
+    return entry ? &entry->sock : NULL;
+}
+
+mic_tcp_sock *get_socket_by_peer(int sys_socket, const struct sockaddr_in *peer) {
+    pthread_rwlock_rdlock(&table_lock);
+    socket_entry_t *entry = hash_find(sys_socket, peer);
+    if (!entry) {
+        entry = hash_find(sys_socket, NULL);
+    }
+    pthread_rwlock_unlock(&table_lock);
+    return entry ? &entry->sock : NULL;
+}
+
+void socket_set_peer(mic_tcp_sock *sock, const struct sockaddr_in *peer) {
+    socket_entry_t *entry = get_entry(sock->fd);
+
+    pthread_rwlock_wrlock(&table_lock);
+    hash_remove(entry);
+    entry->peer = *peer;
+    hash_insert(entry);
+    pthread_rwlock_unlock(&table_lock);
 }
 
 /**
  * @brief Initializes the socket array
  */
 void init_socket_array(void) {
-    for (int i = 0; i < MAX_SOCKETS; i++) {
-        sockets[i].is_used = 0;
+    pthread_rwlock_wrlock(&table_lock);
+    if (!buckets) {
+        hash_grow();
     }
-    next_fd = 0;
-    printf(LOG_PREFIX ANSI_COLOR_GREEN "Socket array initialized" ANSI_COLOR_RESET "\n");
+    pthread_rwlock_unlock(&table_lock);
+    LOG_INFO(LOG_PREFIX ANSI_COLOR_GREEN "Socket array initialized" ANSI_COLOR_RESET "\n");
 }
 
 /*
@@ -39,21 +201,59 @@ void init_socket_array(void) {
 */
 int allocate_new_socket(int sys_socket) {
 
-    if (next_fd == MAX_SOCKETS) {
-        printf(LOG_PREFIX ANSI_COLOR_RED "No available socket slots" ANSI_COLOR_RESET "\n");
+    pthread_rwlock_wrlock(&table_lock);
+    if ((free_head == -1 && grow_table() == -1)
+        || (hashed_sockets >= bucket_count && hash_grow() == -1)) {
+        pthread_rwlock_unlock(&table_lock);
+        LOG_ERROR(LOG_PREFIX ANSI_COLOR_RED "No available socket slots" ANSI_COLOR_RESET "\n");
         return -1;
     }
-    int fd = next_fd++;
-    sockets[fd].is_used = 1;
-    sockets[fd].sock.fd = fd;
-    sockets[fd].sock.sys_socket = sys_socket;
-    sockets[fd].sock.state = CLOSED;
-    sockets[fd].sock.current_seq_num = 0;
-    sockets[fd].sock.received_packets = 0;
-    pthread_mutex_init(&sockets[fd].sock.lock, NULL);
-    pthread_cond_init(&sockets[fd].sock.cond, NULL);
+    int fd = free_head;
+    socket_entry_t *entry = get_entry(fd);
+    free_head = entry->next_free;
+
+    // A reused entry may hold anything from its previous connection
+    memset(&entry->sock, 0, sizeof(entry->sock));
+    memset(&entry->peer, 0, sizeof(entry->peer));
+    entry->peer.sin_family = AF_UNSPEC;
+    entry->sock.fd = fd;
+    entry->sock.sys_socket = sys_socket;
+    entry->sock.state = CLOSED;
+    entry->sock.current_seq_num = 0;
+    entry->sock.received_packets = 0;
+    entry->sock.send_window = NULL;
+    entry->sock.listener_fd = -1;
+    entry->sock.timer_head = -1;
+    entry->sock.timer_next = -1;
+    entry->sock.ack_every = ACK_DELAY_PACKETS;
+    rtt_init(&entry->sock);
+    pthread_mutex_init(&entry->sock.lock, NULL);
+    pthread_cond_init(&entry->sock.cond, NULL);
+
+    hash_insert(entry);
+    entry->is_used = 1;
+    pthread_rwlock_unlock(&table_lock);
 
     return fd;
 
 }
 
+void socket_unhash(mic_tcp_sock *sock) {
+    pthread_rwlock_wrlock(&table_lock);
+    hash_remove(get_entry(sock->fd));
+    pthread_rwlock_unlock(&table_lock);
+}
+
+void release_socket(mic_tcp_sock *sock) {
+    socket_entry_t *entry = get_entry(sock->fd);
+    if (!entry || !entry->is_used) {
+        return;
+    }
+
+    pthread_rwlock_wrlock(&table_lock);
+    hash_remove(entry);
+    entry->is_used = 0;
+    entry->next_free = free_head;
+    free_head = sock->fd;
+    pthread_rwlock_unlock(&table_lock);
+}
@@ -1,8 +1,14 @@
 #include "mictcp/mictcp.h"
 #include "mictcp/mictcp_pdu.h"
 #include "mictcp/sliding_window.h"
+#include "mictcp/send_window.h"
+#include "mictcp/rtt_estimator.h"
+#include "mictcp/congestion.h"
+#include "mictcp/probe.h"
 #include "mictcp/mictcp_config.h"
+#include "mictcp/mictcp_log.h"
 #include "mictcp/mictcp_sock_lookup.h"
+#include "mictcp/event_loop.h"
 #include "api/mictcp_core.h"
 #include <stdio.h>
 #include <time.h>
@@ -17,7 +23,7 @@
  */
 int mic_tcp_socket(start_mode sm) {
 
-    printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_MAGENTA "Initializing socket..." ANSI_COLOR_RESET "\n");
+    LOG_INFO(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_MAGENTA "Initializing socket..." ANSI_COLOR_RESET "\n");
     
     static int initialized = 0;
     if (!initialized) {
@@ -27,7 +33,7 @@ int mic_tcp_socket(start_mode sm) {
     
     int sys_socket = initialize_components(sm); // Returns internal system socket
     if (sys_socket == -1) {
-        printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "System socket initialization failed" ANSI_COLOR_RESET "\n");
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "System socket initialization failed" ANSI_COLOR_RESET "\n");
         return -1;
     }
     
@@ -36,13 +42,32 @@ int mic_tcp_socket(start_mode sm) {
     int fd = allocate_new_socket(sys_socket);
     
     if (fd == -1) {
-        printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Socket initialization failed" ANSI_COLOR_RESET "\n");
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Socket initialization failed" ANSI_COLOR_RESET "\n");
         close(sys_socket);
         return -1;
     }
     
-    printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "Socket created successfully (FD: %d, Sys FD: %d)" 
-           ANSI_COLOR_RESET "\n", fd, sys_socket);
+    // The server receives through the event loop, or through its own core listening thread
+    if (sm == SERVER) {
+#if EVENT_LOOP_THREADS > 0
+        int started = event_loop_register(get_socket_by_fd(fd), SERVER) == 0;
+#else
+        pthread_t listen_th;
+        int started = pthread_create(&listen_th, NULL, listening, (void *)(long)sys_socket) == 0;
+        if (started) {
+            pthread_detach(listen_th);
+        }
+#endif
+        if (!started) {
+            LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Failed to start the network thread" ANSI_COLOR_RESET "\n");
+            release_socket(get_socket_by_fd(fd));
+            close(sys_socket);
+            return -1;
+        }
+    }
+    
+    LOG_INFO(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "Socket created successfully (FD: %d, Sys FD: %d)" 
+             ANSI_COLOR_RESET "\n", fd, sys_socket);
     return fd;
 }
 
@@ -53,86 +78,72 @@ int mic_tcp_socket(start_mode sm) {
  * @return 0 on success, -1 on failure
  */
 int mic_tcp_bind(int socket, mic_tcp_sock_addr addr) {
-    printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_MAGENTA "Binding socket..." ANSI_COLOR_RESET "\n");
+    LOG_INFO(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_MAGENTA "Binding socket..." ANSI_COLOR_RESET "\n");
     
     mic_tcp_sock *sock = get_socket_by_fd(socket);
     if (!sock) {
-        printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Invalid socket FD %d" ANSI_COLOR_RESET "\n", socket);
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Invalid socket FD %d" ANSI_COLOR_RESET "\n", socket);
         return -1;
     }
     
     sock->local_addr = addr;
     socket_set_state(sock, IDLE);
     
-    printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "Socket bound successfully to port %d" 
-           ANSI_COLOR_RESET "\n", addr.port);
+    LOG_INFO(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "Socket bound successfully to port %d" 
+             ANSI_COLOR_RESET "\n", addr.port);
     return 0;
 }
 
 /**
- * @brief Accepts incoming connections using three-way handshake
- * @param socket Socket descriptor
+ * @brief Accepts an incoming connection, the three-way handshake runs in the network thread
+ * @param socket Listening socket descriptor
  * @param addr Pointer to store remote address
- * @return 0 on success, -1 on failure
+ * @return Descriptor of the new connection socket, -1 on failure
  */
 int mic_tcp_accept(int socket, mic_tcp_sock_addr *addr) {
-    printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_MAGENTA "Accepting connection..." ANSI_COLOR_RESET "\n");
+    LOG_INFO(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_MAGENTA "Accepting connection..." ANSI_COLOR_RESET "\n");
     
     mic_tcp_sock *sock = get_socket_by_fd(socket);
     if (!sock) {
-        printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Invalid socket FD %d" ANSI_COLOR_RESET "\n", socket);
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Invalid socket FD %d" ANSI_COLOR_RESET "\n", socket);
         return -1;
     }
     
-    socket_set_state(sock, ACCEPTING);
-    
     pthread_mutex_lock(&sock->lock);
-    if (pthread_cond_wait(&sock->cond, &sock->lock) != 0) {
-        printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Error waiting for SYN" ANSI_COLOR_RESET "\n");
-        pthread_mutex_unlock(&sock->lock);
-        return -1;
+    if (!sock->accept_backlog) {
+        sock->accept_backlog = malloc(ACCEPT_BACKLOG * sizeof(int));
+        if (!sock->accept_backlog) {
+            pthread_mutex_unlock(&sock->lock);
+            LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Failed to allocate accept backlog" ANSI_COLOR_RESET "\n");
+            return -1;
+        }
     }
+    sock->state = ACCEPTING;
     
-    while (sock->state == SYN_RECEIVED) {
-        pthread_mutex_unlock(&sock->lock);
-        
-        printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_YELLOW "Sending SYN+ACK..." ANSI_COLOR_RESET "\n");
-        mic_tcp_pdu response = create_nopayload_pdu(1, 1, 0, 0, 0, 
-                                                   sock->local_addr.port, 
-                                                   sock->remote_addr.port);
-        int result = IP_send(sock->sys_socket, response, sock->remote_addr.ip_addr);
-        if (result == -1) {
-            printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Failed to send SYN+ACK" ANSI_COLOR_RESET "\n");
-            pthread_mutex_lock(&sock->lock);
-            continue;
-        }
-        printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "SYN+ACK sent successfully" ANSI_COLOR_RESET "\n");
-        
-        pthread_mutex_lock(&sock->lock);
-        struct timespec timeout;
-        clock_gettime(CLOCK_REALTIME, &timeout);
-        timeout.tv_sec += TIMEOUT / 1000;
-        timeout.tv_nsec += (TIMEOUT % 1000) * 1e6;
-        if (timeout.tv_nsec > 1e9) {
-            timeout.tv_nsec %= (long) 1e9;
-        }
-        
-        result = pthread_cond_timedwait(&sock->cond, &sock->lock, &timeout);
-        if (result != 0) {
-            if (result == ETIMEDOUT) {
-                printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_YELLOW "Timeout waiting for ACK, retrying SYN+ACK..." 
-                       ANSI_COLOR_RESET "\n");
-                continue;
-            }
-            printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Error waiting for ACK: %d" ANSI_COLOR_RESET "\n", result);
+    // The network thread queues every established connection in the backlog
+    while (sock->backlog_count == 0) {
+        if (pthread_cond_wait(&sock->cond, &sock->lock) != 0) {
+            LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Error waiting for a connection" ANSI_COLOR_RESET "\n");
             pthread_mutex_unlock(&sock->lock);
             return -1;
         }
     }
-    
+    int fd = sock->accept_backlog[sock->backlog_head];
+    sock->backlog_head = (sock->backlog_head + 1) % ACCEPT_BACKLOG;
+    sock->backlog_count--;
     pthread_mutex_unlock(&sock->lock);
-    printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "Connection accepted successfully" ANSI_COLOR_RESET "\n");
-    return 0;
+    
+    mic_tcp_sock *conn = get_socket_by_fd(fd);
+    if (!conn) {
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Connection FD %d vanished" ANSI_COLOR_RESET "\n", fd);
+        return -1;
+    }
+    if (addr) {
+        *addr = conn->remote_addr;
+    }
+    LOG_INFO(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "Connection accepted successfully (FD: %d, Peer: %s)" 
+             ANSI_COLOR_RESET "\n", fd, conn->peer_host);
+    return fd;
 }
 
 /**
@@ -141,21 +152,18 @@ int mic_tcp_accept(int socket, mic_tcp_sock_addr *addr) {
  * @return 0 on success, -1 on failure
  */
 int send_connection_acknowledgement(mic_tcp_sock *sock) {
-    printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_YELLOW "Sending ACK..." ANSI_COLOR_RESET "\n");
+    LOG_DEBUG(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_YELLOW "Sending ACK..." ANSI_COLOR_RESET "\n");
     
     mic_tcp_pdu ack_response = create_nopayload_pdu(0, 1, 0, 0, 0, 
                                                    sock->local_addr.port, 
                                                    sock->remote_addr.port);
-    int result = IP_send(sock->sys_socket, ack_response, sock->remote_addr.ip_addr);
+    int result = IP_send(sock->sys_socket, ack_response, &sock->peer_addr);
     if (result == -1) {
-        printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Failed to send ACK" ANSI_COLOR_RESET "\n");
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Failed to send ACK" ANSI_COLOR_RESET "\n");
         return -1;
     }
     
-    socket_set_state(sock, ESTABLISHED);
-    sock->current_seq_num = 1;
-    printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "ACK sent successfully, connection established" 
-           ANSI_COLOR_RESET "\n");
+    LOG_DEBUG(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "ACK sent successfully" ANSI_COLOR_RESET "\n");
     
     return 0;
 }
@@ -167,127 +175,223 @@ int send_connection_acknowledgement(mic_tcp_sock *sock) {
  * @return 0 on success, -1 on failure
  */
 int mic_tcp_connect(int socket, mic_tcp_sock_addr addr) {
-    printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_MAGENTA "Initiating connection..." ANSI_COLOR_RESET "\n");
+    LOG_INFO(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_MAGENTA "Initiating connection..." ANSI_COLOR_RESET "\n");
     
     mic_tcp_sock *sock = get_socket_by_fd(socket);
     if (!sock) {
-        printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Invalid socket FD %d" ANSI_COLOR_RESET "\n", socket);
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Invalid socket FD %d" ANSI_COLOR_RESET "\n", socket);
         return -1;
     }
     
+    // Resolve the peer once, every PDU of the connection reuses the binary address
+    if (IP_resolve(addr.ip_addr, &sock->peer_addr) == -1) {
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Failed to resolve address %s" ANSI_COLOR_RESET "\n",
+                  addr.ip_addr.addr);
+        return -1;
+    }
+    socket_set_peer(sock, &sock->peer_addr);
+
     int result;
     char syn_to_send = 1;
     char synack_received = 0;
     
     while (syn_to_send || !synack_received) {
-        printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_YELLOW "Sending SYN..." ANSI_COLOR_RESET "\n");
+        LOG_DEBUG(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_YELLOW "Sending SYN..." ANSI_COLOR_RESET "\n");
         mic_tcp_pdu connect_req = create_nopayload_pdu(1, 0, 0, 0, 0, 
                                                       sock->local_addr.port, addr.port);
-        result = IP_send(sock->sys_socket, connect_req, addr.ip_addr);
+        result = IP_send(sock->sys_socket, connect_req, &sock->peer_addr);
         if (result == -1) {
-            printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Failed to send SYN" ANSI_COLOR_RESET "\n");
+            LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Failed to send SYN" ANSI_COLOR_RESET "\n");
             continue;
         }
-        printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "SYN sent successfully" ANSI_COLOR_RESET "\n");
+        LOG_DEBUG(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "SYN sent successfully" ANSI_COLOR_RESET "\n");
         
         syn_to_send = 0;
         socket_set_state(sock, SYN_SENT);
         
         while (!synack_received) {
-            printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_YELLOW "Waiting for SYN+ACK..." ANSI_COLOR_RESET "\n");
+            LOG_DEBUG(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_YELLOW "Waiting for SYN+ACK..." ANSI_COLOR_RESET "\n");
             mic_tcp_pdu received_pdu;
             received_pdu.payload.size = 0;
-            mic_tcp_ip_addr remote_addr;
+            struct sockaddr_in remote_addr;
             
-            result = IP_recv(sock->sys_socket, &received_pdu, &sock->local_addr.ip_addr, &remote_addr, TIMEOUT);
+            result = IP_recv(sock->sys_socket, &received_pdu, &remote_addr,
+                             rtt_get_rto_msec(sock));
             if (result == -1) {
-                printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Failed to receive SYN+ACK" ANSI_COLOR_RESET "\n");
+                LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Failed to receive SYN+ACK" ANSI_COLOR_RESET "\n");
+                rtt_backoff(sock);
                 syn_to_send = 1;
                 break;
             }
             
             if (!verify_pdu(&received_pdu, 1, 1, 0, 0, 0)) {
-                printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_YELLOW "Invalid SYN+ACK received, continuing..." 
-                       ANSI_COLOR_RESET "\n");
+                LOG_WARN(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_YELLOW "Invalid SYN+ACK received, continuing..." 
+                         ANSI_COLOR_RESET "\n");
                 continue;
             }
             
-            printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "SYN+ACK received successfully" ANSI_COLOR_RESET "\n");
+            LOG_DEBUG(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "SYN+ACK received successfully" ANSI_COLOR_RESET "\n");
             synack_received = 1;
         }
     }
     
     sock->remote_addr = addr;
     if (send_connection_acknowledgement(sock) != 0) {
-        printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Connection establishment failed" ANSI_COLOR_RESET "\n");
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Connection establishment failed" ANSI_COLOR_RESET "\n");
         return -1;
     }
+    socket_set_state(sock, ESTABLISHED);
+    sock->current_seq_num = 1;
+    LOG_INFO(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "Connection established" ANSI_COLOR_RESET "\n");
 
-    if (pthread_create(&sock->listen_thread, NULL, (void *(*)(void *))listening_client, (void *)(intptr_t)sock->sys_socket) != 0) {
-        printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Failed to create listening thread" ANSI_COLOR_RESET "\n");
+    if (send_window_init(sock) != 0) {
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Failed to allocate send window" ANSI_COLOR_RESET "\n");
+        return -1;
+    }
+
+#if EVENT_LOOP_THREADS > 0
+    if (event_loop_register(sock, CLIENT) != 0) {
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Failed to register in the event loop" ANSI_COLOR_RESET "\n");
+        return -1;
+    }
+#else
+    if (pthread_create(&sock->listen_thread, NULL, (void *(*)(void *))listening_client, (void *)(intptr_t)sock->fd) != 0) {
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Failed to create listening thread" ANSI_COLOR_RESET "\n");
         return -1;
     }
+#endif
     
     socket_set_state(sock, MEASURING_RELIABILITY);
     
-    for (int i = 0; i < MESURING_RELIABILITY_PACKET_NUMBER; i++) {
-        mic_tcp_pdu packet = create_nopayload_pdu(0, 0, 0, 0, 0, 
-                                                 sock->local_addr.port, 
-                                                 sock->remote_addr.port);
-        packet.payload.data = MESURING_PAYLOAD;
-        packet.payload.size = strlen(packet.payload.data);
-        
-        printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_YELLOW "Sending reliability Packet %d/%d..." 
-               ANSI_COLOR_RESET "\n", i + 1, MESURING_RELIABILITY_PACKET_NUMBER);
-        result = IP_send(sock->sys_socket, packet, sock->remote_addr.ip_addr);
-        if (result == -1) {
-            printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Failed to send reliability packet %d" 
-                   ANSI_COLOR_RESET "\n", i + 1);
-            continue;
-        }
-
-        struct timespec timeout;
-        clock_gettime(CLOCK_REALTIME, &timeout);
-        timeout.tv_sec += TIMEOUT / 1000;
-
-        pthread_mutex_lock(&sock->lock);
-        pthread_cond_timedwait(&sock->cond, &sock->lock, &timeout); // Wait for the last ACKs to arrive
-        pthread_mutex_unlock(&sock->lock);
+    float loss_rate = probe_run(sock);
+    if (loss_rate < 0) {
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Failed to probe the channel" ANSI_COLOR_RESET "\n");
+        return -1;
     }
+    LOG_INFO(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_CYAN "Channel reliability: %.1f%% (%d packets received out of %d)" 
+             ANSI_COLOR_RESET "\n", 100.0 - loss_rate, sock->received_packets, MESURING_RELIABILITY_PACKET_NUMBER);
     
-    pthread_mutex_lock(&sock->lock); // Retreive loss rate
-    float success_rate = 100.0 * sock->received_packets / MESURING_RELIABILITY_PACKET_NUMBER;
+    pthread_mutex_lock(&sock->lock);
+    int window_ready = sock->sliding_window || loss_window_init(sock, LOSS_WINDOW_SIZE) == 0;
+    sock->sliding_window_consecutive_loss = loss_policy_accepted_losses(loss_rate, sock->sliding_window_size);
     pthread_mutex_unlock(&sock->lock);
-    float loss_rate = 100.0 - success_rate;
-    printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_CYAN "Channel reliability: %.1f%% (%d packets received out of %d)" 
-           ANSI_COLOR_RESET "\n", success_rate, sock->received_packets, MESURING_RELIABILITY_PACKET_NUMBER);
-    
-    sock->sliding_window_size = 10;
-    if (loss_rate < 2.0) {
-        sock->sliding_window_consecutive_loss = 0;
-    } else if (loss_rate >= 2.0 && loss_rate < 5.0) {
-        sock->sliding_window_consecutive_loss = 1;
-    } else if (loss_rate >= 5.0 && loss_rate < 12.0) {
-        sock->sliding_window_consecutive_loss = 2;
-    } else if (loss_rate >= 12.0 && loss_rate <= 20.0) {
-        sock->sliding_window_consecutive_loss = 3;
-    } else {
-        printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Channel too unreliable (%.1f%% loss), closing connection..." 
-               ANSI_COLOR_RESET "\n", loss_rate);
+    if (!window_ready) {
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Failed to allocate loss window" ANSI_COLOR_RESET "\n");
+        return -1;
+    }
+    sock->loss_estimate = loss_rate;
+    if (sock->sliding_window_consecutive_loss < 0) {
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Channel too unreliable (%.1f%% loss), closing connection..." 
+                  ANSI_COLOR_RESET "\n", loss_rate);
         mic_tcp_close(socket);
-        printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Channel too unreliable (%.1f%% loss), connection closed." 
-               ANSI_COLOR_RESET "\n", loss_rate);
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Channel too unreliable (%.1f%% loss), connection closed." 
+                  ANSI_COLOR_RESET "\n", loss_rate);
         return -1;
     }
     
-    printf(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "Connection established with %d%% acceptable loss rate" 
-           ANSI_COLOR_RESET "\n", 
-           (sock->sliding_window_size - sock->sliding_window_consecutive_loss) * 100 / sock->sliding_window_size);
+    LOG_INFO(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "Connection established with %d%% acceptable loss rate" 
+             ANSI_COLOR_RESET "\n", 
+             (sock->sliding_window_size - sock->sliding_window_consecutive_loss) * 100 / sock->sliding_window_size);
     socket_set_state(sock, ESTABLISHED);
 
     return 0;
 }
 
+/**
+ * @brief Installs an impairment model on the system socket of a MIC-TCP socket
+ * @param socket Socket descriptor
+ * @param model Impairment model, NULL to go back to the default loss rate
+ * @return 0 on success, -1 on failure
+ */
+int mic_tcp_set_impairment(int socket, const mic_tcp_impairment *model) {
+    mic_tcp_sock *sock = get_socket_by_fd(socket);
+    if (!sock) {
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Invalid socket FD %d" ANSI_COLOR_RESET "\n", socket);
+        return -1;
+    }
+    if (sock->shares_sys_socket) {
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Socket FD %d shares the system socket of its listening socket, "
+                  "set the impairment model on the listening socket" ANSI_COLOR_RESET "\n", socket);
+        return -1;
+    }
+    if (IP_set_impairment(sock->sys_socket, model) == -1) {
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Failed to install the impairment model" ANSI_COLOR_RESET "\n");
+        return -1;
+    }
+    LOG_INFO(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "Impairment model %s on Sys FD %d" ANSI_COLOR_RESET "\n",
+             model ? "installed" : "removed", sock->sys_socket);
+    return 0;
+}
+
+/**
+ * @brief Sets the number of transmissions the loss tolerance is computed over
+ * @param socket Socket descriptor
+ * @param size Window size, between 1 and LOSS_WINDOW_MAX transmissions
+ * @return 0 on success, -1 on failure
+ */
+int mic_tcp_set_loss_window(int socket, int size) {
+    mic_tcp_sock *sock = get_socket_by_fd(socket);
+    if (!sock) {
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Invalid socket FD %d" ANSI_COLOR_RESET "\n", socket);
+        return -1;
+    }
+
+    pthread_mutex_lock(&sock->lock);
+    if (loss_window_init(sock, size) == -1) {
+        pthread_mutex_unlock(&sock->lock);
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Invalid loss window size %d" ANSI_COLOR_RESET "\n", size);
+        return -1;
+    }
+    pthread_mutex_unlock(&sock->lock);
+
+    LOG_INFO(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "Loss window of %d transmissions" ANSI_COLOR_RESET "\n", size);
+    return 0;
+}
+
+/**
+ * @brief Chooses the congestion control algorithm of a socket
+ * @param socket Socket descriptor
+ * @param algorithm CONGESTION_NEWRENO or CONGESTION_DELAY
+ * @return 0 on success, -1 on failure
+ */
+int mic_tcp_set_congestion(int socket, mic_tcp_congestion algorithm) {
+    mic_tcp_sock *sock = get_socket_by_fd(socket);
+    if (!sock || (algorithm != CONGESTION_NEWRENO && algorithm != CONGESTION_DELAY)) {
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Invalid socket FD %d or congestion control %d"
+                  ANSI_COLOR_RESET "\n", socket, algorithm);
+        return -1;
+    }
+
+    pthread_mutex_lock(&sock->lock);
+    congestion_init(sock, algorithm);
+    pthread_mutex_unlock(&sock->lock);
+
+    LOG_INFO(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "Congestion control: %s" ANSI_COLOR_RESET "\n",
+             algorithm == CONGESTION_DELAY ? "delay" : "NewReno");
+    return 0;
+}
+
+/**
+ * @brief Sets how many in-order PDUs a connection acknowledges with a single ACK
+ * @param socket Socket descriptor
+ * @param packets PDUs per ACK, 1 to acknowledge every PDU at once
+ * @return 0 on success, -1 on failure
+ */
+int mic_tcp_set_delayed_ack(int socket, int packets) {
+    mic_tcp_sock *sock = get_socket_by_fd(socket);
+    if (!sock || packets < 1 || packets > SEND_WINDOW_SIZE) {
+        LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Invalid socket FD %d or delayed ACK count %d"
+                  ANSI_COLOR_RESET "\n", socket, packets);
+        return -1;
+    }
+
+    // Read by the network thread on the next PDU, a pending ACK still leaves with its batch
+    __atomic_store_n(&sock->ack_every, packets, __ATOMIC_RELAXED);
+
+    LOG_INFO(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_GREEN "Delayed ACKs: one ACK every %d PDUs" ANSI_COLOR_RESET "\n", packets);
+    return 0;
+}
+
 void socket_set_state(mic_tcp_sock* socket, protocol_state state) {
     pthread_mutex_lock(&socket->lock);
     socket->state = state;
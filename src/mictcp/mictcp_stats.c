@@ -0,0 +1,70 @@
+#include "mictcp/mictcp_stats.h"
+#include "mictcp/mictcp_config.h"
+#include "mictcp/mictcp_log.h"
+#include "mictcp/mictcp_sock_lookup.h"
+
+/*
+ * The counters live in the socket and are only touched with relaxed atomic
+ * increments, so the data path takes no lock for them. A reader copies them
+ * one by one: each counter is exact, but the copy is not a snapshot.
+ *
+ * Latencies are bucketed by their power of two: bucket i counts the delays in
+ * [2^i, 2^(i+1)) microseconds, the last bucket also holds everything above.
+ */
+
+void stats_record_latency(mic_tcp_sock *sock, unsigned long latency_usec) {
+    int bucket = (int) (8 * sizeof(unsigned long)) - 1 - __builtin_clzl(latency_usec | 1);
+    if (bucket >= MIC_TCP_LATENCY_BUCKETS) {
+        bucket = MIC_TCP_LATENCY_BUCKETS - 1;
+    }
+    STATS_ADD(sock, latency_histogram[bucket], 1);
+}
+
+int mic_tcp_getstats(int socket, struct mic_tcp_stats *stats) {
+    mic_tcp_sock *sock = get_socket_by_fd(socket);
+    if (!sock || !stats) {
+        return -1;
+    }
+
+    stats->packets_sent = __atomic_load_n(&sock->stats.packets_sent, __ATOMIC_RELAXED);
+    stats->bytes_sent = __atomic_load_n(&sock->stats.bytes_sent, __ATOMIC_RELAXED);
+    stats->packets_received = __atomic_load_n(&sock->stats.packets_received, __ATOMIC_RELAXED);
+    stats->bytes_received = __atomic_load_n(&sock->stats.bytes_received, __ATOMIC_RELAXED);
+    stats->retransmissions = __atomic_load_n(&sock->stats.retransmissions, __ATOMIC_RELAXED);
+    stats->losses_accepted = __atomic_load_n(&sock->stats.losses_accepted, __ATOMIC_RELAXED);
+    stats->deadlines_missed = __atomic_load_n(&sock->stats.deadlines_missed, __ATOMIC_RELAXED);
+    stats->duplicates = __atomic_load_n(&sock->stats.duplicates, __ATOMIC_RELAXED);
+    stats->window_probes = __atomic_load_n(&sock->stats.window_probes, __ATOMIC_RELAXED);
+    stats->out_of_order = __atomic_load_n(&sock->stats.out_of_order, __ATOMIC_RELAXED);
+    stats->sacked = __atomic_load_n(&sock->stats.sacked, __ATOMIC_RELAXED);
+    stats->timeouts = __atomic_load_n(&sock->stats.timeouts, __ATOMIC_RELAXED);
+    stats->fast_retransmits = __atomic_load_n(&sock->stats.fast_retransmits, __ATOMIC_RELAXED);
+    stats->tail_probes = __atomic_load_n(&sock->stats.tail_probes, __ATOMIC_RELAXED);
+    stats->acks_sent = __atomic_load_n(&sock->stats.acks_sent, __ATOMIC_RELAXED);
+    stats->measured_loss_rate = sock->stats.measured_loss_rate;
+    stats->loss_estimate = sock->loss_estimate;
+    stats->accepted_losses = sock->sliding_window_consecutive_loss;
+    stats->loss_window = sock->sliding_window_size;
+    stats->measured_rtt = sock->stats.measured_rtt;
+    stats->bandwidth_estimate = sock->stats.bandwidth_estimate;
+    stats->rto = __atomic_load_n(&sock->rto, __ATOMIC_RELAXED);
+    stats->cwnd = __atomic_load_n(&sock->cwnd, __ATOMIC_RELAXED);
+    stats->ssthresh = __atomic_load_n(&sock->ssthresh, __ATOMIC_RELAXED);
+    for (int i = 0; i < MIC_TCP_LATENCY_BUCKETS; i++) {
+        stats->latency_histogram[i] = __atomic_load_n(&sock->stats.latency_histogram[i], __ATOMIC_RELAXED);
+    }
+    return 0;
+}
+
+void stats_log(mic_tcp_sock *sock) {
+    mic_tcp_stats stats;
+    if (mic_tcp_getstats(sock->fd, &stats) == -1) {
+        return;
+    }
+    LOG_INFO(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_CYAN "Sent %lu PDUs/%lu B, received %lu PDUs/%lu B, "
+             "retransmitted %lu, given up %lu, past deadline %lu, duplicates %lu, timeouts %lu, RTO %lu us, cwnd %u/%u, loss estimate %.1f%%"
+             ANSI_COLOR_RESET "\n",
+             stats.packets_sent, stats.bytes_sent, stats.packets_received, stats.bytes_received,
+             stats.retransmissions, stats.losses_accepted, stats.deadlines_missed, stats.duplicates, stats.timeouts, stats.rto,
+             stats.cwnd, stats.ssthresh, stats.loss_estimate);
+}
@@ -0,0 +1,224 @@
+#include "mictcp/probe.h"
+#include "mictcp/mictcp_pdu.h"
+#include "mictcp/rtt_estimator.h"
+#include "mictcp/mictcp_config.h"
+#include "mictcp/mictcp_log.h"
+#include "api/mictcp_core.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * The probes are numbered from 1 in their seq_num and leave in a single
+ * burst. The peer acknowledges each of them with its number in seq_num and
+ * ack_num 0, so a late probe ACK is never mistaken for a data ACK. The ACK
+ * echoes the probe timestamp (RTT) and carries the date the peer processed
+ * the probe.
+ *
+ * Packet train: the probes leave back to back, so the spread between the
+ * first and the last processing date at the peer is the time the bottleneck
+ * took to carry the other received probes. The dates have a 1 us resolution
+ * and probes read in the same receive batch get nearly the same date: a
+ * train whose spread stays within that resolution carries no information
+ * and the bandwidth estimate is left at 0.
+ *
+ * The phase ends when every probe is acknowledged, or two RTOs after the end
+ * of the burst. Once most probes are acknowledged, the wait shortens to two of
+ * the largest RTTs measured so far, but never below one RTO: the first ACKs
+ * of a busy peer say nothing of the others.
+ */
+
+static int compare_ulong(const void *a, const void *b) {
+    unsigned long la = *(const unsigned long *) a;
+    unsigned long lb = *(const unsigned long *) b;
+    return (la > lb) - (la < lb);
+}
+
+static unsigned long median(unsigned long *values, int count) {
+    if (count == 0) {
+        return 0;
+    }
+    qsort(values, count, sizeof(unsigned long), compare_ulong);
+    return values[count / 2];
+}
+
+static void add_usec(struct timespec *deadline, unsigned long usec) {
+    deadline->tv_sec += usec / 1000000;
+    deadline->tv_nsec += (usec % 1000000) * 1000;
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+int probe_is_probe(mic_tcp_pdu *pdu) {
+    return pdu->payload.size >= (int) sizeof(MESURING_PAYLOAD)
+           && memcmp(pdu->payload.data, MESURING_PAYLOAD, sizeof(MESURING_PAYLOAD)) == 0;
+}
+
+void probe_acknowledge(mic_tcp_sock *sock, mic_tcp_pdu *ack) {
+    unsigned int number = ack->header.seq_num;
+
+    pthread_mutex_lock(&sock->lock);
+    probe_results *probes = sock->probes;
+    if (!probes || number == 0 || number > (unsigned int) probes->count
+        || probes->rtt[number - 1] != 0 || ack->header.timestamp_echo == 0) {
+        pthread_mutex_unlock(&sock->lock);
+        return;
+    }
+
+    unsigned long rtt = (unsigned int) get_now_time_usec() - ack->header.timestamp_echo;
+    probes->rtt[number - 1] = rtt ? rtt : 1;
+    probes->arrival[number - 1] = ack->header.timestamp;
+    if (probes->rtt[number - 1] > probes->max_rtt) {
+        probes->max_rtt = probes->rtt[number - 1];
+    }
+    sock->received_packets++;
+    pthread_cond_signal(&sock->cond);
+    pthread_mutex_unlock(&sock->lock);
+}
+
+/**
+ * @brief Sends the whole burst of probes, batched when the core allows it
+ */
+static void send_burst(mic_tcp_sock *sock, int count) {
+    char payload[PROBE_PAYLOAD_SIZE];
+    memset(payload, 0, sizeof(payload));
+    memcpy(payload, MESURING_PAYLOAD, sizeof(MESURING_PAYLOAD));
+
+    IP_send_batch_begin();
+    for (int i = 0; i < count; i++) {
+        mic_tcp_pdu packet = create_nopayload_pdu(0, 0, 0, i + 1, 0,
+                                                  sock->local_addr.port,
+                                                  sock->remote_addr.port);
+        packet.payload.data = payload;
+        packet.payload.size = sizeof(payload);
+        if (IP_send(sock->sys_socket, packet, &sock->peer_addr) == -1) {
+            LOG_ERROR(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Failed to send probe %d" ANSI_COLOR_RESET "\n", i + 1);
+        }
+    }
+    IP_send_batch_flush();
+}
+
+/**
+ * @brief Waits for the probe ACKs until all arrived or the phase times out
+ */
+static void wait_acknowledgments(mic_tcp_sock *sock) {
+    struct timespec burst_end;
+    clock_gettime(CLOCK_REALTIME, &burst_end);
+
+    pthread_mutex_lock(&sock->lock);
+    while (sock->received_packets < sock->probes->count) {
+        unsigned long wait = 2 * sock->rto;
+        if (2 * sock->received_packets > sock->probes->count) {
+            unsigned long rtt_wait = 2 * sock->probes->max_rtt;
+            wait = rtt_wait > sock->rto ? rtt_wait : sock->rto;
+        }
+        struct timespec deadline = burst_end;
+        add_usec(&deadline, wait);
+
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        if (now.tv_sec > deadline.tv_sec || (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec)) {
+            break;
+        }
+        pthread_cond_timedwait(&sock->cond, &sock->lock, &deadline);
+    }
+    pthread_mutex_unlock(&sock->lock);
+}
+
+/**
+ * @brief Turns the probe measurements into estimates, sock->lock must be held
+ */
+static void compute_estimates(mic_tcp_sock *sock, unsigned long *samples) {
+    probe_results *probes = sock->probes;
+
+    int rtt_count = 0;
+    for (int i = 0; i < probes->count; i++) {
+        if (probes->rtt[i]) {
+            samples[rtt_count++] = probes->rtt[i];
+        }
+    }
+    sock->stats.measured_rtt = median(samples, rtt_count);
+
+    // Dates are 32-bit microseconds, taken relative to the first received probe
+    int received = 0;
+    unsigned int origin = 0;
+    long first = 0, last = 0;
+    for (int i = 0; i < probes->count; i++) {
+        if (!probes->rtt[i]) {
+            continue;
+        }
+        if (received++ == 0) {
+            origin = probes->arrival[i];
+        }
+        long offset = (int) (probes->arrival[i] - origin);
+        if (offset < first) {
+            first = offset;
+        }
+        if (offset > last) {
+            last = offset;
+        }
+    }
+    unsigned long spread = last - first;
+    unsigned long probe_bits = (unsigned long) (API_HD_Size + PROBE_PAYLOAD_SIZE) * 8;
+    sock->stats.bandwidth_estimate = received > 1 && spread > (unsigned long) (received - 1) && spread < 1000000
+                                     ? (received - 1) * probe_bits * 1000000UL / spread : 0;
+
+    // The probe RTT seeds the estimator, as a first RFC 6298 measurement
+    if (rtt_count > 0) {
+        rtt_init(sock);
+        rtt_update(sock, sock->stats.measured_rtt);
+    }
+}
+
+float probe_run(mic_tcp_sock *sock) {
+    const int count = MESURING_RELIABILITY_PACKET_NUMBER;
+
+    probe_results *probes = calloc(1, sizeof(probe_results));
+    unsigned long *samples = calloc(count, sizeof(unsigned long));
+    if (probes) {
+        probes->count = count;
+        probes->rtt = calloc(count, sizeof(unsigned long));
+        probes->arrival = calloc(count, sizeof(unsigned int));
+    }
+    if (!probes || !probes->rtt || !probes->arrival || !samples) {
+        if (probes) {
+            free(probes->rtt);
+            free(probes->arrival);
+        }
+        free(probes);
+        free(samples);
+        return -1;
+    }
+
+    pthread_mutex_lock(&sock->lock);
+    sock->received_packets = 0;
+    sock->probes = probes;
+    pthread_mutex_unlock(&sock->lock);
+
+    probes->start = get_now_time_usec();
+    LOG_DEBUG(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_YELLOW "Sending %d probes..." ANSI_COLOR_RESET "\n", count);
+    send_burst(sock, count);
+    wait_acknowledgments(sock);
+
+    pthread_mutex_lock(&sock->lock);
+    int received = sock->received_packets;
+    compute_estimates(sock, samples);
+    sock->probes = NULL;
+    pthread_mutex_unlock(&sock->lock);
+
+    float loss_rate = 100.0 - 100.0 * received / count;
+    sock->stats.measured_loss_rate = loss_rate;
+    LOG_INFO(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_CYAN "Probing done in %lu us: %d/%d probes acknowledged, "
+             "RTT %lu us, bandwidth %lu kbit/s" ANSI_COLOR_RESET "\n",
+             get_now_time_usec() - probes->start, received, count,
+             sock->stats.measured_rtt, sock->stats.bandwidth_estimate / 1000);
+
+    free(probes->rtt);
+    free(probes->arrival);
+    free(probes);
+    free(samples);
+    return loss_rate;
+}
@@ -0,0 +1,224 @@
+#include "mictcp/reorder_buffer.h"
+#include "mictcp/mictcp_stats.h"
+#include "mictcp/mictcp_config.h"
+#include "mictcp/mictcp_log.h"
+#include "api/mictcp_core.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The receiver accepts any data PDU within [current_seq_num,
+ * current_seq_num + SEND_WINDOW_SIZE): the sender never has more in flight,
+ * and once its abandoned PDUs are skipped, its send_base is never ahead of
+ * our current_seq_num. The next expected
+ * PDU goes straight to the receive queue, the others are copied in the slot
+ * seq_num % SEND_WINDOW_SIZE until the gap before them fills.
+ *
+ * Held PDUs need no room of their own in the advertised window: the sender
+ * counts them in its flight footprint until our ack_num passes them, so the
+ * receive queue always has room for them once they are in sequence.
+ *
+ * ACKs keep a cumulative ack_num and describe the held PDUs as SACK blocks,
+ * the sender then only retransmits the real holes. The ACK of the first PDU
+ * held past a gap also carries the NACK flag, so the sender retransmits the
+ * missing PDU without waiting for duplicate ACKs. A held PDU is never
+ * dropped once acknowledged this way, except when the sender gives up the
+ * gap before it and the receive queue has no room left.
+ *
+ * The sender marks SACKed PDUs as delivered and never sends them again, so
+ * whatever carries its window base skips the abandoned gaps and delivers
+ * them: data PDUs, but also empty PDUs (window probes, or the notice sent
+ * once nothing else is in flight) and the FIN, before the end of stream.
+ *
+ * Only the network thread of the connection touches the reorder buffer and
+ * current_seq_num, no lock is needed.
+ */
+
+static reorder_slot *get_slot(mic_tcp_sock *sock, unsigned int seq_num) {
+    return &sock->reorder_buffer[seq_num % SEND_WINDOW_SIZE];
+}
+
+static int is_held(mic_tcp_sock *sock, unsigned int seq_num) {
+    reorder_slot *slot = get_slot(sock, seq_num);
+    return slot->present && slot->seq_num == seq_num;
+}
+
+/**
+ * @brief Copies an out of order PDU in its slot
+ * @return 0 on success, -1 if the copy could not be allocated
+ */
+static int hold(mic_tcp_sock *sock, mic_tcp_pdu *pdu) {
+    reorder_slot *slot = get_slot(sock, pdu->header.seq_num);
+    if (slot->capacity < pdu->payload.size) {
+        char *data = realloc(slot->data, pdu->payload.size);
+        if (!data) {
+            return -1;
+        }
+        slot->data = data;
+        slot->capacity = pdu->payload.size;
+    }
+    memcpy(slot->data, pdu->payload.data, pdu->payload.size);
+    slot->size = pdu->payload.size;
+    slot->seq_num = pdu->header.seq_num;
+    slot->present = 1;
+    sock->reorder_held++;
+    return 0;
+}
+
+/**
+ * @brief Moves a held PDU to the receive queue
+ * @return 0 on success, -1 if the receive queue is full (the PDU stays held)
+ */
+static int deliver(mic_tcp_sock *sock, reorder_slot *slot) {
+    mic_tcp_payload payload;
+    payload.data = slot->data;
+    payload.size = slot->size;
+    if (app_buffer_put(&sock->recv_buffer, payload) != 0) {
+        return -1;
+    }
+    slot->present = 0;
+    sock->reorder_held--;
+    return 0;
+}
+
+/**
+ * @brief Delivers the held PDUs that are now in sequence
+ */
+static void drain(mic_tcp_sock *sock) {
+    while (is_held(sock, sock->current_seq_num)) {
+        if (deliver(sock, get_slot(sock, sock->current_seq_num)) != 0) {
+            LOG_WARN(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_RED "Application buffer full, holding Seq %d"
+                     ANSI_COLOR_RESET "\n", sock->current_seq_num);
+            return;
+        }
+        LOG_DEBUG(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_GREEN "Held packet delivered (Seq: %d)"
+                  ANSI_COLOR_RESET "\n", sock->current_seq_num);
+        sock->current_seq_num++;
+    }
+}
+
+/**
+ * @brief Moves current_seq_num to the window base of the sender, delivering what was held before it
+ */
+static void skip_to(mic_tcp_sock *sock, unsigned int base) {
+    LOG_WARN(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Sender gave up Seq %d to %d, skipping"
+             ANSI_COLOR_RESET "\n", sock->current_seq_num, base - 1);
+
+    // Nothing is held beyond a full window, whatever the size of the skip
+    unsigned int end = base - sock->current_seq_num > SEND_WINDOW_SIZE
+                       ? sock->current_seq_num + SEND_WINDOW_SIZE : base;
+    for (unsigned int seq = sock->current_seq_num; seq != end; seq++) {
+        if (is_held(sock, seq) && deliver(sock, get_slot(sock, seq)) != 0) {
+            LOG_WARN(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_RED "Application buffer full, dropping held Seq %d"
+                     ANSI_COLOR_RESET "\n", seq);
+            get_slot(sock, seq)->present = 0;
+            sock->reorder_held--;
+        }
+    }
+    sock->current_seq_num = base;
+}
+
+int reorder_buffer_init(mic_tcp_sock *sock) {
+    sock->reorder_buffer = calloc(SEND_WINDOW_SIZE, sizeof(reorder_slot));
+    sock->reorder_held = 0;
+    return sock->reorder_buffer ? 0 : -1;
+}
+
+void reorder_buffer_free(mic_tcp_sock *sock) {
+    if (!sock->reorder_buffer) {
+        return;
+    }
+    for (int i = 0; i < SEND_WINDOW_SIZE; i++) {
+        free(sock->reorder_buffer[i].data);
+    }
+    free(sock->reorder_buffer);
+    sock->reorder_buffer = NULL;
+}
+
+void reorder_buffer_skip(mic_tcp_sock *sock, unsigned int base) {
+    if ((int)(base - sock->current_seq_num) > 0) {
+        skip_to(sock, base);
+        drain(sock);
+    }
+}
+
+int reorder_buffer_receive(mic_tcp_sock *sock, mic_tcp_pdu *pdu) {
+    unsigned int seq_num = pdu->header.seq_num;
+    int gap = 0;
+
+    // ack_num of a data PDU is the sender's window base: everything below was given up
+    reorder_buffer_skip(sock, pdu->header.ack_num);
+
+    int offset = (int)(seq_num - sock->current_seq_num);
+    if (offset < 0 || is_held(sock, seq_num)) {
+        STATS_ADD(sock, duplicates, 1);
+    } else if (offset >= SEND_WINDOW_SIZE) {
+        LOG_WARN(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_RED "Seq %d beyond the receive window, dropping"
+                 ANSI_COLOR_RESET "\n", seq_num);
+    } else if (offset == 0) {
+        // A full receive queue refuses the PDU, the ACK then asks for it again
+        if (app_buffer_put(&sock->recv_buffer, pdu->payload) == 0) {
+            sock->current_seq_num++;
+            LOG_DEBUG(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_GREEN "Data packet Accepted, using %d Bytes"
+                      ANSI_COLOR_RESET "\n", pdu->payload.size);
+        } else {
+            LOG_WARN(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_RED "Application buffer full, dropping Seq %d"
+                     ANSI_COLOR_RESET "\n", seq_num);
+        }
+    } else if (hold(sock, pdu) == 0) {
+        STATS_ADD(sock, out_of_order, 1);
+        LOG_DEBUG(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Holding out of order packet (Seq: %d, Expected: %d)"
+                  ANSI_COLOR_RESET "\n", seq_num, sock->current_seq_num);
+        // Each gap is reported once, the next held PDUs only extend the SACK blocks
+        if ((!sock->nack_sent || sock->nack_seq != sock->current_seq_num) && !is_held(sock, sock->current_seq_num)) {
+            sock->nack_sent = 1;
+            sock->nack_seq = sock->current_seq_num;
+            gap = 1;
+        }
+    } else {
+        LOG_ERROR(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_RED "Failed to hold Seq %d, dropping"
+                  ANSI_COLOR_RESET "\n", seq_num);
+    }
+
+    drain(sock);
+    return gap;
+}
+
+void reorder_buffer_fill_sack(mic_tcp_sock *sock, mic_tcp_pdu *ack, unsigned int trigger) {
+    const unsigned int current = sock->current_seq_num;
+    mic_tcp_sack_block *blocks = ack->header.sack;
+    int count = 0;
+
+    // RFC 2018: the first block reports the PDU that triggered the ACK
+    if (trigger != current && is_held(sock, trigger)) {
+        unsigned int start = trigger;
+        unsigned int end = trigger + 1;
+        while (start - 1 != current && is_held(sock, start - 1)) {
+            start--;
+        }
+        while (end - current < SEND_WINDOW_SIZE && is_held(sock, end)) {
+            end++;
+        }
+        blocks[count].start = start;
+        blocks[count].end = end;
+        count++;
+    }
+
+    unsigned int seq = current + 1;
+    while (count < MIC_TCP_SACK_BLOCKS && seq - current < SEND_WINDOW_SIZE) {
+        if (!is_held(sock, seq)) {
+            seq++;
+            continue;
+        }
+        unsigned int start = seq;
+        while (seq - current < SEND_WINDOW_SIZE && is_held(sock, seq)) {
+            seq++;
+        }
+        if (count == 0 || start != blocks[0].start) {
+            blocks[count].start = start;
+            blocks[count].end = seq;
+            count++;
+        }
+    }
+}
@@ -0,0 +1,91 @@
+#include "mictcp/rtt_estimator.h"
+#include "mictcp/mictcp_config.h"
+#include "mictcp/mictcp_log.h"
+#include "api/mictcp_core.h"
+#include <stdio.h>
+
+/*
+ * RTO = SRTT + max(G, 4 * RTTVAR), with
+ *   first sample R : SRTT = R, RTTVAR = R / 2
+ *   next samples   : RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, SRTT = 7/8 SRTT + 1/8 R
+ * The RTO is clamped to [RTO_MIN_USEC, RTO_MAX_USEC] and doubled on every timeout.
+ *
+ * Karn's rule leaves no sample while the lost PDUs are being retransmitted, so
+ * the backoff is also cleared as soon as an ACK acknowledges new data, otherwise
+ * successive losses would keep doubling the RTO up to RTO_MAX_USEC.
+ */
+
+static unsigned long clamp_rto(unsigned long rto) {
+    if (rto < RTO_MIN_USEC) {
+        return RTO_MIN_USEC;
+    }
+    if (rto > RTO_MAX_USEC) {
+        return RTO_MAX_USEC;
+    }
+    return rto;
+}
+
+void rtt_init(mic_tcp_sock *sock) {
+    sock->srtt = 0;
+    sock->rttvar = 0;
+    sock->rto_base = TIMEOUT * 1000UL;
+    sock->rto = sock->rto_base;
+}
+
+void rtt_update(mic_tcp_sock *sock, unsigned long sample_usec) {
+    if (sample_usec == 0) {
+        sample_usec = 1;
+    }
+
+    if (sock->srtt == 0) {
+        sock->srtt = sample_usec;
+        sock->rttvar = sample_usec / 2;
+    } else {
+        unsigned long delta = sock->srtt > sample_usec ? sock->srtt - sample_usec : sample_usec - sock->srtt;
+        sock->rttvar = (3 * sock->rttvar + delta) / 4;
+        sock->srtt = (7 * sock->srtt + sample_usec) / 8;
+    }
+
+    unsigned long variance = 4 * sock->rttvar;
+    sock->rto_base = clamp_rto(sock->srtt + (variance > RTO_CLOCK_GRANULARITY_USEC ? variance : RTO_CLOCK_GRANULARITY_USEC));
+    sock->rto = sock->rto_base;
+
+    LOG_DEBUG(LOG_PREFIX ANSI_COLOR_CYAN "RTT sample: %lu us (SRTT: %lu us, RTTVAR: %lu us, RTO: %lu us)"
+              ANSI_COLOR_RESET "\n", sample_usec, sock->srtt, sock->rttvar, sock->rto);
+}
+
+unsigned long rtt_update_from_echo(mic_tcp_sock *sock, mic_tcp_pdu *pdu) {
+    if (pdu->header.timestamp_echo == 0) {
+        return 0;
+    }
+    // Timestamps are truncated to 32 bits, the difference stays valid across a wrap
+    unsigned int now = (unsigned int) get_now_time_usec();
+    unsigned int sample = now - pdu->header.timestamp_echo;
+    rtt_update(sock, sample);
+    return sample ? sample : 1;
+}
+
+void rtt_backoff(mic_tcp_sock *sock) {
+    sock->rto = clamp_rto(2 * sock->rto);
+    LOG_WARN(LOG_PREFIX ANSI_COLOR_YELLOW "RTO backed off to %lu us" ANSI_COLOR_RESET "\n", sock->rto);
+}
+
+void rtt_reset_backoff(mic_tcp_sock *sock) {
+    sock->rto = sock->rto_base;
+}
+
+unsigned long rtt_get_rto_msec(mic_tcp_sock *sock) {
+    return (sock->rto + 999) / 1000;
+}
+
+void rtt_deadline(mic_tcp_sock *sock, struct timespec *deadline, int factor) {
+    unsigned long delay_usec = factor * sock->rto;
+
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += delay_usec / 1000000;
+    deadline->tv_nsec += (delay_usec % 1000000) * 1000;
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
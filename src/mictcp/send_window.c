@@ -0,0 +1,579 @@
+#include "mictcp/send_window.h"
+#include "mictcp/sliding_window.h"
+#include "mictcp/mictcp_pdu.h"
+#include "mictcp/rtt_estimator.h"
+#include "mictcp/congestion.h"
+#include "mictcp/mictcp_stats.h"
+#include "mictcp/mictcp_config.h"
+#include "mictcp/mictcp_log.h"
+#include "api/mictcp_core.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * The send window keeps up to SEND_WINDOW_SIZE data PDUs in flight. Slots are
+ * indexed by seq_num % SEND_WINDOW_SIZE, every slot owns a copy of its payload
+ * so that it can be retransmitted without the application buffer.
+ *
+ * [send_base, current_seq_num) are the PDUs still in flight. Each of them has
+ * its own retransmission timer, armed with the RTO of the socket. When a timer
+ * expires, the loss tolerance of the sliding window decides whether the PDU is
+ * retransmitted or given up. The RTO is backed off when the oldest PDU expires.
+ * A PDU sent with a deadline is given up at its first expiry past the deadline,
+ * whatever the loss tolerance: a late retransmission would be useless. A
+ * reliable PDU is always retransmitted and stays out of the loss window, so
+ * the tolerance is only spent on the lossy ones.
+ *
+ * ACKs are cumulative and may carry SACK blocks: the PDUs the peer holds
+ * beyond its ack_num, waiting for a gap to fill. They are marked done so their
+ * timers no longer fire, only the real holes are retransmitted. They keep
+ * their footprint until send_base passes them, the peer still stores them.
+ *
+ * Fast retransmit: the PDU at send_base is presumed lost without waiting for
+ * its timer after CONGESTION_DUPACK_THRESHOLD duplicate ACKs (ACKs stuck on
+ * send_base that report new SACKed PDUs or leave the window unchanged), or
+ * when the receiver NACKs it. A NACK is only trusted once the PDU was sent a
+ * quarter of an RTT more than an RTT ago (RFC 8985 reordering window): a
+ * reordered PDU arrives in the meantime and cancels it. Until send_base
+ * passes the recovery point, every partial ACK reveals the next hole, handled
+ * the same way (RFC 6582). Like an expiry, the loss tolerance then decides
+ * whether the PDU is retransmitted or given up.
+ *
+ * Tail loss probe (RFC 8985): the last PDUs of a burst bring no duplicate
+ * ACKs. Once no ACK moved send_base for two smoothed RTTs after the last
+ * transmission, the last PDU is sent again, ahead of the RTO: its ACK either
+ * acknowledges everything or carries the SACK blocks and NACK that reveal the
+ * holes.
+ *
+ * ACKs echo the timestamp of the PDU that triggered them. Following Karn's
+ * rule, only ACKs for PDUs sent exactly once produce an RTT sample.
+ *
+ * Data PDUs carry send_base in their ack_num field: every sequence number
+ * below it is either acknowledged or given up, so the receiver may skip the
+ * abandoned ones instead of waiting for them forever. So do window probes
+ * and the FIN. When the PDUs after a given up one were all SACKed and
+ * nothing else is queued, no data PDU would carry the new send_base: an
+ * empty PDU does, resent every RTO until an ACK reaches current_seq_num.
+ *
+ * The congestion controller bounds the PDUs in flight below SEND_WINDOW_SIZE:
+ * it is told about new ACKs, duplicate ACKs and expiries of the oldest PDU.
+ *
+ * Flow control: every ACK advertises the free space of the receive queue of
+ * the peer, counted from its ack_num. The PDUs in flight will take
+ * flight_footprint bytes there, so a new PDU only leaves if it still fits in
+ * the advertised window. When the window is too small and nothing is in
+ * flight, no ACK would ever reopen it: an empty PDU probes the peer every
+ * RTO, with an exponential backoff while the window stays closed.
+ *
+ * All the fields are protected by sock->lock. The main thread fills the
+ * window, the network thread empties it and signals sock->cond.
+ */
+
+static send_window_slot *get_slot(mic_tcp_sock *sock, unsigned int seq_num) {
+    return &sock->send_window[seq_num % SEND_WINDOW_SIZE];
+}
+
+/**
+ * @brief Sends (or resends) the PDU held in a slot, sock->lock must be held
+ */
+static int transmit_slot(mic_tcp_sock *sock, send_window_slot *slot) {
+    mic_tcp_pdu packet = create_nopayload_pdu(0, 0, 0, slot->seq_num, sock->send_base,
+                                              sock->local_addr.port,
+                                              sock->remote_addr.port);
+    packet.payload.data = slot->data;
+    packet.payload.size = slot->size;
+
+    slot->sent_time = get_now_time_usec();
+    if (slot->transmissions++ == 0) {
+        slot->first_sent_time = slot->sent_time;
+    }
+    packet.header.timestamp = (unsigned int) slot->sent_time;
+    STATS_ADD(sock, packets_sent, 1);
+    STATS_ADD(sock, bytes_sent, slot->size);
+    return IP_send(sock->sys_socket, packet, &sock->peer_addr);
+}
+
+/**
+ * @brief Sends an empty PDU asking the peer for its receive window, sock->lock must be held
+ */
+static void probe_window(mic_tcp_sock *sock, unsigned long now) {
+    mic_tcp_pdu probe = create_nopayload_pdu(0, 0, 0, sock->current_seq_num, sock->send_base,
+                                             sock->local_addr.port,
+                                             sock->remote_addr.port);
+    sock->persist_time = now;
+    if (sock->persist_backoff < 16) {
+        sock->persist_backoff++;
+    }
+    STATS_ADD(sock, window_probes, 1);
+    LOG_DEBUG(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Peer window %u B too small, probing..." ANSI_COLOR_RESET "\n",
+              sock->peer_window);
+    IP_send(sock->sys_socket, probe, &sock->peer_addr);
+}
+
+/**
+ * @brief Tells the peer it may skip the PDUs given up before send_base, sock->lock must be held
+ */
+static void check_skip(mic_tcp_sock *sock, unsigned long now) {
+    if (!sock->skip_pending || sock->send_base != sock->current_seq_num
+        || (sock->skip_time && now - sock->skip_time < sock->rto)) {
+        return;
+    }
+    mic_tcp_pdu skip = create_nopayload_pdu(0, 0, 0, sock->current_seq_num, sock->send_base,
+                                            sock->local_addr.port,
+                                            sock->remote_addr.port);
+    sock->skip_time = now;
+    LOG_DEBUG(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Nothing left in flight, telling the peer to skip to Seq %d"
+              ANSI_COLOR_RESET "\n", sock->send_base);
+    IP_send(sock->sys_socket, skip, &sock->peer_addr);
+}
+
+/**
+ * @brief Delay between two zero window probes, sock->lock must be held
+ */
+static unsigned long persist_interval(mic_tcp_sock *sock) {
+    unsigned long interval = sock->rto << sock->persist_backoff;
+    return interval < RTO_MAX_USEC ? interval : RTO_MAX_USEC;
+}
+
+/**
+ * @brief Records the reception of an in-flight PDU by the peer, sock->lock must be held
+ */
+static void slot_received(mic_tcp_sock *sock, send_window_slot *slot, unsigned long now) {
+    slot->done = 1;
+    stats_record_latency(sock, now - slot->first_sent_time);
+    if (!slot->reliable) {
+        update_sliding_window(sock, 1);
+    }
+    loss_estimate_update(sock, 0);
+}
+
+/**
+ * @brief Marks the PDUs reported by the SACK blocks of an ACK as received, sock->lock must be held
+ * @return Number of PDUs newly acknowledged by the blocks
+ */
+static unsigned int apply_sack(mic_tcp_sock *sock, mic_tcp_pdu *ack) {
+    unsigned long now = get_now_time_usec();
+    unsigned int sacked = 0;
+    for (int i = 0; i < MIC_TCP_SACK_BLOCKS; i++) {
+        mic_tcp_sack_block *block = &ack->header.sack[i];
+        // A block is at most SEND_WINDOW_SIZE long: it stops at the edge of the PDUs in flight
+        for (unsigned int seq = block->start; seq != block->end; seq++) {
+            if (seq - sock->send_base >= sock->current_seq_num - sock->send_base) {
+                break;
+            }
+            send_window_slot *slot = get_slot(sock, seq);
+            if (!slot->done) {
+                slot_received(sock, slot, now);
+                STATS_ADD(sock, sacked, 1);
+                sacked++;
+            }
+        }
+    }
+    return sacked;
+}
+
+/**
+ * @brief Gives up or retransmits an in-flight PDU presumed lost, sock->lock must be held
+ */
+static void recover_slot(mic_tcp_sock *sock, send_window_slot *slot, unsigned long now) {
+    // Each expiry of a PDU under backoff is not a new loss of the channel
+    if (!slot->loss_counted) {
+        slot->loss_counted = 1;
+        loss_estimate_update(sock, 1);
+    }
+    if (slot->deadline && now >= slot->deadline) {
+        LOG_DEBUG(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Deadline passed, giving up Seq %d" ANSI_COLOR_RESET "\n",
+                  slot->seq_num);
+        slot->done = 1;
+        sock->skip_pending = 1;
+        sock->skip_time = 0;
+        STATS_ADD(sock, deadlines_missed, 1);
+    } else if (!slot->reliable && verify_acceptable_loss(sock)) {
+        LOG_DEBUG(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_GREEN "Loss acceptable, giving up Seq %d" ANSI_COLOR_RESET "\n",
+                  slot->seq_num);
+        slot->done = 1;
+        sock->skip_pending = 1;
+        sock->skip_time = 0;
+        update_sliding_window(sock, 0);
+        STATS_ADD(sock, losses_accepted, 1);
+    } else {
+        LOG_DEBUG(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Retransmitting packet (Seq: %d, Attempt: %d)..."
+                  ANSI_COLOR_RESET "\n", slot->seq_num, slot->transmissions + 1);
+        STATS_ADD(sock, retransmissions, 1);
+        transmit_slot(sock, slot);
+    }
+}
+
+/**
+ * @brief Moves send_base past the acknowledged or abandoned PDUs, sock->lock must be held
+ * @return 1 if the window moved, 0 otherwise
+ */
+static int advance_base(mic_tcp_sock *sock) {
+    unsigned int previous_base = sock->send_base;
+    while (sock->send_base != sock->current_seq_num && get_slot(sock, sock->send_base)->done) {
+        sock->flight_footprint -= API_APP_BUFFER_Footprint(get_slot(sock, sock->send_base)->size);
+        sock->send_base++;
+    }
+    return sock->send_base != previous_base;
+}
+
+/**
+ * @brief Handles the PDU at send_base as lost ahead of its timer, sock->lock must be held
+ */
+static void fast_retransmit(mic_tcp_sock *sock) {
+    send_window_slot *slot = get_slot(sock, sock->send_base);
+    unsigned long now = get_now_time_usec();
+    // A copy sent less than an RTT ago cannot be judged by the ACKs received so far
+    if (sock->send_base == sock->current_seq_num || slot->done || now - slot->sent_time < sock->srtt) {
+        return;
+    }
+    LOG_DEBUG(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Fast retransmit (Seq: %d)" ANSI_COLOR_RESET "\n",
+              slot->seq_num);
+    STATS_ADD(sock, fast_retransmits, 1);
+    sock->nack_pending = 0;
+    recover_slot(sock, slot, now);
+    advance_base(sock);
+}
+
+/**
+ * @brief Delay before a NACK of the PDU at send_base is trusted, sock->lock must be held
+ * @return Delay in microseconds, 0 if it may be acted upon now
+ */
+static unsigned long nack_delay(mic_tcp_sock *sock, unsigned long now) {
+    unsigned long elapsed = now - get_slot(sock, sock->send_base)->sent_time;
+    unsigned long wait = sock->srtt + sock->srtt / 4;
+    return elapsed >= wait ? 0 : wait - elapsed;
+}
+
+/**
+ * @brief Retransmits the PDU at send_base once its NACK is past the reordering window, sock->lock must be held
+ */
+static void check_nack(mic_tcp_sock *sock, unsigned long now) {
+    if (!sock->nack_pending) {
+        return;
+    }
+    if (sock->send_base == sock->current_seq_num || get_slot(sock, sock->send_base)->done) {
+        sock->nack_pending = 0;
+        return;
+    }
+    if (nack_delay(sock, now)) {
+        return;
+    }
+    sock->nack_pending = 0;
+    congestion_on_nack(sock);
+    fast_retransmit(sock);
+}
+
+/**
+ * @brief Delay after the last transmission before the tail loss probe, sock->lock must be held
+ * @return Delay in microseconds, 0 if no probe is armed
+ */
+static unsigned long tail_probe_timeout(mic_tcp_sock *sock) {
+    if (sock->tail_probe_sent || sock->srtt == 0 || sock->send_base == sock->current_seq_num
+        || get_slot(sock, sock->current_seq_num - 1)->done) {
+        return 0;
+    }
+    unsigned long timeout = 2 * sock->srtt;
+    if (timeout < TAIL_LOSS_PROBE_MIN_USEC) {
+        timeout = TAIL_LOSS_PROBE_MIN_USEC;
+    }
+    // The retransmission timer would fire first
+    return timeout < sock->rto ? timeout : 0;
+}
+
+int send_window_init(mic_tcp_sock *sock) {
+    sock->send_window = calloc(SEND_WINDOW_SIZE, sizeof(send_window_slot));
+    if (!sock->send_window) {
+        return -1;
+    }
+    sock->send_base = sock->current_seq_num;
+    sock->peer_window = API_APP_BUFFER_Size;
+    sock->flight_footprint = 0;
+    sock->window_blocked = 0;
+    sock->persist_backoff = 0;
+    sock->tail_probe_sent = 0;
+    sock->nack_pending = 0;
+    if (!sock->congestion) {
+        congestion_init(sock, CONGESTION_NEWRENO);
+    }
+    return 0;
+}
+
+void send_window_free(mic_tcp_sock *sock) {
+    if (!sock->send_window) {
+        return;
+    }
+    for (int i = 0; i < SEND_WINDOW_SIZE; i++) {
+        free(sock->send_window[i].data);
+    }
+    free(sock->send_window);
+    sock->send_window = NULL;
+}
+
+int send_window_push(mic_tcp_sock *sock, char *msg, int msg_size, unsigned long deadline, int flags) {
+    pthread_mutex_lock(&sock->lock);
+
+    unsigned int footprint = API_APP_BUFFER_Footprint(msg_size);
+    while (sock->current_seq_num - sock->send_base >= congestion_window(sock)
+           || sock->flight_footprint + footprint > sock->peer_window) {
+        if (sock->state != ESTABLISHED) {
+            pthread_mutex_unlock(&sock->lock);
+            return -1;
+        }
+        if (deadline && get_now_time_usec() >= deadline) {
+            STATS_ADD(sock, deadlines_missed, 1);
+            pthread_mutex_unlock(&sock->lock);
+            LOG_WARN(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_YELLOW "Deadline passed before the message could be sent"
+                     ANSI_COLOR_RESET "\n");
+            return 0;
+        }
+        // Only a closed peer window with nothing in flight needs the network thread to probe
+        if (sock->current_seq_num == sock->send_base && !sock->window_blocked) {
+            sock->window_blocked = 1;
+            sock->persist_time = get_now_time_usec();
+            sock->persist_backoff = 0;
+        }
+        LOG_WARN(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_YELLOW "Send window full, waiting for ACKs..." ANSI_COLOR_RESET "\n");
+        struct timespec deadline;
+        rtt_deadline(sock, &deadline, 1);
+        pthread_cond_timedwait(&sock->cond, &sock->lock, &deadline);
+    }
+
+    sock->window_blocked = 0;
+
+    send_window_slot *slot = get_slot(sock, sock->current_seq_num);
+    if (slot->capacity < msg_size) {
+        char *data = realloc(slot->data, msg_size);
+        if (!data) {
+            pthread_mutex_unlock(&sock->lock);
+            return -1;
+        }
+        slot->data = data;
+        slot->capacity = msg_size;
+    }
+    memcpy(slot->data, msg, msg_size);
+    slot->size = msg_size;
+    slot->seq_num = sock->current_seq_num++;
+    sock->flight_footprint += footprint;
+    slot->transmissions = 0;
+    slot->deadline = deadline;
+    slot->reliable = (flags & MIC_TCP_SEND_RELIABLE) != 0;
+    slot->done = 0;
+    slot->loss_counted = 0;
+
+    LOG_DEBUG(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_YELLOW "Sending packet (Seq: %d, In flight: %d)..." ANSI_COLOR_RESET "\n",
+              slot->seq_num, sock->current_seq_num - sock->send_base);
+    int result = transmit_slot(sock, slot);
+    pthread_mutex_unlock(&sock->lock);
+
+    if (result == -1) {
+        LOG_WARN(LOG_PREFIX_MAIN_THREAD ANSI_COLOR_RED "Failed to send packet, retransmission timer armed" ANSI_COLOR_RESET "\n");
+    }
+    return msg_size;
+}
+
+void send_window_acknowledge(mic_tcp_sock *sock, mic_tcp_pdu *ack) {
+    unsigned int ack_num = ack->header.ack_num;
+
+    pthread_mutex_lock(&sock->lock);
+
+    // The peer got or skipped everything sent so far
+    if (ack_num == sock->current_seq_num) {
+        sock->skip_pending = 0;
+    }
+
+    // Every ACK within [send_base, current_seq_num] carries the current receive window of the peer,
+    // and the PDUs it holds out of order
+    int window_update = 0;
+    unsigned int sacked = 0;
+    if (sock->send_window && ack_num - sock->send_base <= sock->current_seq_num - sock->send_base) {
+        window_update = ack->header.window != sock->peer_window;
+        sock->peer_window = ack->header.window;
+        sacked = apply_sack(sock, ack);
+    }
+
+    // An ACK stuck on send_base: a window update, or the PDU at send_base went missing (RFC 6675 duplicate ACK)
+    if (sock->send_window && ack_num == sock->send_base) {
+        if (sock->send_base != sock->current_seq_num && (sacked || ack->header.nack || !window_update)) {
+            sock->nack_pending |= ack->header.nack;
+            if (congestion_on_duplicate_ack(sock)) {
+                fast_retransmit(sock);
+            }
+            check_nack(sock, get_now_time_usec());
+            check_skip(sock, get_now_time_usec());
+        } else if (window_update) {
+            LOG_DEBUG(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_CYAN "Peer window: %u B" ANSI_COLOR_RESET "\n", sock->peer_window);
+        }
+        pthread_cond_broadcast(&sock->cond);
+        pthread_mutex_unlock(&sock->lock);
+        return;
+    }
+
+    // Ignore ACKs outside of ]send_base, current_seq_num] (duplicates or stale)
+    if (!sock->send_window || ack_num - sock->send_base - 1 >= sock->current_seq_num - sock->send_base) {
+        pthread_mutex_unlock(&sock->lock);
+        return;
+    }
+
+    // Karn's rule: only measure the RTT if the acknowledged PDU was never retransmitted
+    send_window_slot *last_acked = get_slot(sock, ack_num - 1);
+    unsigned long rtt_sample = 0;
+    if (!last_acked->done && last_acked->transmissions == 1
+        && ack->header.timestamp_echo == (unsigned int) last_acked->sent_time) {
+        rtt_sample = rtt_update_from_echo(sock, ack);
+    }
+
+    unsigned int acked = ack_num - sock->send_base;
+    unsigned long now = get_now_time_usec();
+    for (unsigned int seq = sock->send_base; seq != ack_num; seq++) {
+        send_window_slot *slot = get_slot(sock, seq);
+        sock->flight_footprint -= API_APP_BUFFER_Footprint(slot->size);
+        if (!slot->done) {
+            slot_received(sock, slot, now);
+        }
+    }
+    sock->send_base = ack_num;
+    advance_base(sock);
+    rtt_reset_backoff(sock);
+    congestion_on_ack(sock, acked, rtt_sample);
+    sock->tail_probe_sent = 0;
+
+    // Still in recovery, this partial ACK stops on the next hole, otherwise its NACK may report one
+    sock->nack_pending = ack->header.nack;
+    if (sock->in_recovery) {
+        fast_retransmit(sock);
+    }
+    check_nack(sock, now);
+    check_skip(sock, now);
+
+    LOG_DEBUG(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_GREEN "ACK received (Ack: %d, In flight: %d, cwnd: %u)"
+              ANSI_COLOR_RESET "\n", ack_num, sock->current_seq_num - sock->send_base, sock->cwnd);
+    pthread_cond_broadcast(&sock->cond);
+    pthread_mutex_unlock(&sock->lock);
+}
+
+void send_window_check_timeouts(mic_tcp_sock *sock) {
+    pthread_mutex_lock(&sock->lock);
+    if (!sock->send_window) {
+        pthread_mutex_unlock(&sock->lock);
+        return;
+    }
+
+    unsigned long now = get_now_time_usec();
+    int base_expired = 0;
+    for (unsigned int seq = sock->send_base; seq != sock->current_seq_num; seq++) {
+        send_window_slot *slot = get_slot(sock, seq);
+        if (slot->done || now - slot->sent_time < sock->rto) {
+            continue;
+        }
+        base_expired |= seq == sock->send_base;
+        STATS_ADD(sock, timeouts, 1);
+
+        LOG_DEBUG(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Timeout waiting for ACK (Seq: %d)..." ANSI_COLOR_RESET "\n",
+                  seq);
+        recover_slot(sock, slot, now);
+    }
+
+    // Back off once per expiry of the oldest PDU, not once per expired slot
+    if (base_expired) {
+        rtt_backoff(sock);
+        congestion_on_timeout(sock);
+        sock->tail_probe_sent = 0;
+        sock->nack_pending = 0;
+    }
+    check_nack(sock, now);
+    if (advance_base(sock)) {
+        pthread_cond_broadcast(&sock->cond);
+    }
+    check_skip(sock, now);
+
+    // Tail loss probe: no later PDU will bring duplicate ACKs for the last one of the burst
+    unsigned long probe_timeout = tail_probe_timeout(sock);
+    send_window_slot *last = get_slot(sock, sock->current_seq_num - 1);
+    if (probe_timeout && now - last->sent_time >= probe_timeout) {
+        LOG_DEBUG(LOG_PREFIX_NETWORK_THREAD ANSI_COLOR_YELLOW "Tail loss probe (Seq: %d)..." ANSI_COLOR_RESET "\n",
+                  last->seq_num);
+        sock->tail_probe_sent = 1;
+        STATS_ADD(sock, tail_probes, 1);
+        STATS_ADD(sock, retransmissions, 1);
+        transmit_slot(sock, last);
+    }
+
+    // Persist timer: nothing in flight will bring the window update of the peer
+    if (sock->window_blocked && sock->send_base == sock->current_seq_num
+        && now - sock->persist_time >= persist_interval(sock)) {
+        probe_window(sock, now);
+    }
+    pthread_mutex_unlock(&sock->lock);
+}
+
+unsigned long send_window_next_timeout(mic_tcp_sock *sock) {
+    pthread_mutex_lock(&sock->lock);
+    unsigned long delay = sock->rto;
+    if (sock->send_window) {
+        unsigned long now = get_now_time_usec();
+        for (unsigned int seq = sock->send_base; seq != sock->current_seq_num; seq++) {
+            send_window_slot *slot = get_slot(sock, seq);
+            if (slot->done) {
+                continue;
+            }
+            unsigned long elapsed = now - slot->sent_time;
+            unsigned long remaining = elapsed >= sock->rto ? 0 : sock->rto - elapsed;
+            if (remaining < delay) {
+                delay = remaining;
+            }
+        }
+        if (sock->nack_pending && sock->send_base != sock->current_seq_num) {
+            unsigned long remaining = nack_delay(sock, now);
+            if (remaining < delay) {
+                delay = remaining;
+            }
+        }
+        unsigned long probe_timeout = tail_probe_timeout(sock);
+        if (probe_timeout) {
+            unsigned long elapsed = now - get_slot(sock, sock->current_seq_num - 1)->sent_time;
+            unsigned long remaining = elapsed >= probe_timeout ? 0 : probe_timeout - elapsed;
+            if (remaining < delay) {
+                delay = remaining;
+            }
+        }
+        if (sock->skip_pending && sock->send_base == sock->current_seq_num) {
+            unsigned long elapsed = now - sock->skip_time;
+            unsigned long remaining = elapsed >= sock->rto ? 0 : sock->rto - elapsed;
+            if (remaining < delay) {
+                delay = remaining;
+            }
+        }
+        if (sock->window_blocked && sock->send_base == sock->current_seq_num) {
+            unsigned long elapsed = now - sock->persist_time;
+            unsigned long interval = persist_interval(sock);
+            unsigned long remaining = elapsed >= interval ? 0 : interval - elapsed;
+            if (remaining < delay) {
+                delay = remaining;
+            }
+        }
+    }
+    pthread_mutex_unlock(&sock->lock);
+
+    delay = (delay + 999) / 1000;
+    return delay > 0 ? delay : 1;
+}
+
+int send_window_flush(mic_tcp_sock *sock) {
+    int idle_periods = 0;
+
+    pthread_mutex_lock(&sock->lock);
+    while (sock->send_window && sock->send_base != sock->current_seq_num && idle_periods < MAX_ATTEMPTS) {
+        unsigned int previous_base = sock->send_base;
+        struct timespec deadline;
+        rtt_deadline(sock, &deadline, 1);
+        pthread_cond_timedwait(&sock->cond, &sock->lock, &deadline);
+        idle_periods = sock->send_base == previous_base ? idle_periods + 1 : 0;
+    }
+    int result = (!sock->send_window || sock->send_base == sock->current_seq_num) ? 0 : -1;
+    pthread_mutex_unlock(&sock->lock);
+
+    return result;
+}
@@ -1,6 +1,8 @@
 #include "mictcp/mictcp.h"
 #include "mictcp/mictcp_config.h"
+#include "mictcp/mictcp_log.h"
 #include <stdio.h>
+#include <stdlib.h>
 
 /*
 
@@ -14,29 +16,118 @@
 ║ x > 20%                  ║ Refuse connection             ║ Channel too unreliable      ║
 ╚══════════════════════════╩═══════════════════════════════╩═════════════════════════════╝
 
+The table sets the tolerance at connection time from the probed loss rate.
+Afterwards, every acknowledged transmission and the first loss of each PDU
+feed an EWMA of the loss rate (the later expiries of a PDU under backoff are
+not new losses), and the tolerance follows it through the same table. A level
+only changes once the estimate is LOSS_POLICY_HYSTERESIS past its bounds. The
+margin is wider than the step of a single outcome (100 / LOSS_ESTIMATE_WEIGHT
+points), so one loss never flips the tolerance on its own. An estimate above
+20% keeps the highest tolerance: the connection is already up.
+
+The counts of the table are out of 10 transmissions and scale with the size
+of the loss window, which mic_tcp_set_loss_window can stretch up to
+LOSS_WINDOW_MAX transmissions (5 out of 50, 50 out of 500...).
+
+The window is a circular bitset, one bit per transmission (1 = acknowledged):
+recording an outcome overwrites the oldest bit and adjusts a running count of
+the successes, so checking the tolerance is O(1) whatever the window size.
+
 */
 
+typedef struct {
+    float max_loss_rate;   // Upper bound of the level, in percent
+    int accepted_losses;   // Losses accepted out of LOSS_POLICY_WINDOW transmissions
+} loss_policy_level;
+
+static const loss_policy_level loss_policy[] = {
+    { 2.0, 0 },
+    { 5.0, 1 },
+    { 12.0, 2 },
+    { 20.0, 3 },
+};
+
+#define LOSS_POLICY_LEVELS ((int) (sizeof(loss_policy) / sizeof(loss_policy[0])))
+#define LOSS_POLICY_WINDOW 10
+
+#define WORD_BITS 64
+#define WORD_COUNT(size) (((size) + WORD_BITS - 1) / WORD_BITS)
+
+/**
+ * @brief Accepted losses of a policy level, scaled to the loss window of a socket
+ */
+static int scaled_losses(int level, int window_size) {
+    return loss_policy[level].accepted_losses * window_size / LOSS_POLICY_WINDOW;
+}
+
+/**
+ * @brief Finds the policy level currently applied to a socket
+ */
+static int current_level(mic_tcp_sock *sock) {
+    int level = 0;
+    while (level < LOSS_POLICY_LEVELS - 1
+           && scaled_losses(level, sock->sliding_window_size) < sock->sliding_window_consecutive_loss) {
+        level++;
+    }
+    return level;
+}
+
+static inline int window_bit(mic_tcp_sock *sock, int position) {
+    return (sock->sliding_window[position / WORD_BITS] >> (position % WORD_BITS)) & 1;
+}
+
+int loss_window_init(mic_tcp_sock *sock, int size) {
+    if (size < 1 || size > LOSS_WINDOW_MAX) {
+        return -1;
+    }
+    unsigned long long *window = calloc(WORD_COUNT(size), sizeof(unsigned long long));
+    if (!window) {
+        return -1;
+    }
+    // An established connection keeps its policy level, scaled to the new size
+    int level = current_level(sock);
+    free(sock->sliding_window);
+    sock->sliding_window = window;
+    sock->sliding_window_head = 0;
+    sock->sliding_window_successes = 0;
+    sock->sliding_window_size = size;
+    sock->sliding_window_consecutive_loss = scaled_losses(level, size);
+    return 0;
+}
+
+void loss_window_free(mic_tcp_sock *sock) {
+    free(sock->sliding_window);
+    sock->sliding_window = NULL;
+}
+
 /**
  * @brief Updates the sliding window with packet reception status and displays it
  * @param sock MIC-TCP socket containing sliding window fields
  * @param received 1 if packet was received, 0 otherwise
  */
 void update_sliding_window(mic_tcp_sock *sock, char received) {
-    // Shift window left and add new bit
-    sock->sliding_window <<= 1;
+    // Overwrite the oldest transmission with the new one
+    int position = sock->sliding_window_head;
+    unsigned long long mask = 1ULL << (position % WORD_BITS);
+    sock->sliding_window_successes += (received != 0) - window_bit(sock, position);
     if (received) {
-        sock->sliding_window |= 1;
+        sock->sliding_window[position / WORD_BITS] |= mask;
+    } else {
+        sock->sliding_window[position / WORD_BITS] &= ~mask;
     }
-    sock->sliding_window &= (1 << sock->sliding_window_size) - 1;
-
-    // Display sliding window status with colored indicators
-    printf(LOG_PREFIX ANSI_COLOR_CYAN "Sliding window status: " ANSI_COLOR_RESET);
-    for (int i = 0; i < sock->sliding_window_size; i++) {
-        printf("%s%s" ANSI_COLOR_RESET, 
-               (sock->sliding_window >> i) & 1 ? ANSI_COLOR_GREEN : ANSI_COLOR_RED,
-               (sock->sliding_window >> i) & 1 ? "●" : "○");
+    sock->sliding_window_head = position + 1 == sock->sliding_window_size ? 0 : position + 1;
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+    // Display the most recent transmissions with colored indicators, as a single log record
+    char status[LOG_RECORD_SIZE] = "";
+    int length = 0;
+    for (int i = 0; i < sock->sliding_window_size && length < (int) sizeof(status); i++) {
+        int bit = window_bit(sock, (position - i + sock->sliding_window_size) % sock->sliding_window_size);
+        length += snprintf(status + length, sizeof(status) - length, "%s%s" ANSI_COLOR_RESET,
+                           bit ? ANSI_COLOR_GREEN : ANSI_COLOR_RED, bit ? "●" : "○");
     }
-    printf("\n");
+    LOG_DEBUG(LOG_PREFIX ANSI_COLOR_CYAN "Sliding window status: " ANSI_COLOR_RESET "%s\n", status);
+#endif
 }
 
 /**
@@ -45,21 +136,46 @@ void update_sliding_window(mic_tcp_sock *sock, char received) {
  * @return 1 if acceptable, 0 if too many losses
  */
 char verify_acceptable_loss(mic_tcp_sock *sock) {
-    unsigned int count = 0;
-    int window = sock->sliding_window;
-    
-    // Count successful transmissions
-    while (window) {
-        count += window & 1;
-        window >>= 1;
-    }
-    
     // Verify if loss rate is acceptable
-    char result = count > (sock->sliding_window_size - sock->sliding_window_consecutive_loss);
-    printf(LOG_PREFIX "%sLoss verification: %s (successes: %u, minimum: %d)" ANSI_COLOR_RESET "\n",
-           result ? ANSI_COLOR_GREEN : ANSI_COLOR_RED,
-           result ? "ACCEPTABLE" : "UNACCEPTABLE",
-           count, sock->sliding_window_size - sock->sliding_window_consecutive_loss);
+    int count = sock->sliding_window_successes;
+    char result = count > sock->sliding_window_size - sock->sliding_window_consecutive_loss;
+    LOG_DEBUG(LOG_PREFIX "%sLoss verification: %s (successes: %d, minimum: %d)" ANSI_COLOR_RESET "\n",
+              result ? ANSI_COLOR_GREEN : ANSI_COLOR_RED,
+              result ? "ACCEPTABLE" : "UNACCEPTABLE",
+              count, sock->sliding_window_size - sock->sliding_window_consecutive_loss);
     
     return result;
-}
\ No newline at end of file
+}
+
+int loss_policy_accepted_losses(float loss_rate, int window_size) {
+    for (int i = 0; i < LOSS_POLICY_LEVELS - 1; i++) {
+        if (loss_rate < loss_policy[i].max_loss_rate) {
+            return scaled_losses(i, window_size);
+        }
+    }
+    return loss_rate <= loss_policy[LOSS_POLICY_LEVELS - 1].max_loss_rate
+           ? scaled_losses(LOSS_POLICY_LEVELS - 1, window_size) : -1;
+}
+
+void loss_estimate_update(mic_tcp_sock *sock, char lost) {
+    sock->loss_estimate += ((lost ? 100.0f : 0.0f) - sock->loss_estimate) / LOSS_ESTIMATE_WEIGHT;
+
+    int level = current_level(sock);
+    int previous_level = level;
+    while (level < LOSS_POLICY_LEVELS - 1
+           && sock->loss_estimate >= loss_policy[level].max_loss_rate + LOSS_POLICY_HYSTERESIS) {
+        level++;
+    }
+    while (level > 0
+           && sock->loss_estimate < loss_policy[level - 1].max_loss_rate - LOSS_POLICY_HYSTERESIS) {
+        level--;
+    }
+    if (level == previous_level) {
+        return;
+    }
+
+    sock->sliding_window_consecutive_loss = scaled_losses(level, sock->sliding_window_size);
+    LOG_INFO(LOG_PREFIX ANSI_COLOR_CYAN "Loss estimate %.1f%%, now accepting %d losses out of %d"
+             ANSI_COLOR_RESET "\n", sock->loss_estimate, sock->sliding_window_consecutive_loss,
+             sock->sliding_window_size);
+}